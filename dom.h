@@ -26,7 +26,6 @@
 #ifndef DOM_LIBRARY_H
 #define DOM_LIBRARY_H
 
-#include <queue>
 #include <list>
 #include <vector>
 #include <memory>
@@ -38,6 +37,34 @@
 #include <tuple>
 #include <limits>
 #include <iostream>
+#include <iterator>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define DOM_HAS_PMR 1
+#endif
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define DOM_HAS_MMAP 1
+#if defined(__linux__)
+#include <sys/syscall.h>
+#define DOM_HAS_NUMA 1
+#endif
+#endif
 
 using EntityID = uint64_t;
 using SubID = uint16_t;
@@ -45,9 +72,281 @@ using SubID = uint16_t;
 namespace dom
 {
     constexpr unsigned short DEFAULT_COMPONENT_COUNT = 256;
+    constexpr std::size_t DEFAULT_BLOCK_SIZE = 8192;
+    constexpr std::size_t CACHE_LINE_SIZE = 64; ///<every pool block starts on a cache line
+    constexpr std::size_t MAX_PAGE_SIZE = 65536; ///<largest common page size, blocks of flat pools start on a multiple of it
 
     template <typename CINDEX, CINDEX COMP_TOTAL> class Universe;
 
+    /** \brief Returns the index of the lowest set bit. The word must not be zero. */
+    inline unsigned countTrailingZeros(uint64_t word)
+    {
+    #if defined(__GNUC__) || defined(__clang__)
+        return static_cast<unsigned>(__builtin_ctzll(word));
+    #elif defined(_MSC_VER) && defined(_M_X64)
+        unsigned long index;
+        _BitScanForward64(&index, word);
+        return static_cast<unsigned>(index);
+    #else
+        unsigned n = 0;
+        while (!(word & 1u)) { word >>= 1; ++n; }
+        return n;
+    #endif
+    }
+
+    /**
+    * \brief Returns the number of set bits. A single instruction where the target has popcnt (e.g. -mpopcnt
+    * or -march=native on x86), otherwise a few inlined arithmetic steps instead of a library call.
+    */
+    inline unsigned popcount(uint64_t word)
+    {
+    #if (defined(__GNUC__) || defined(__clang__)) && (defined(__POPCNT__) || defined(__aarch64__))
+        return static_cast<unsigned>(__builtin_popcountll(word));
+    #elif defined(_MSC_VER) && defined(_M_X64)
+        return static_cast<unsigned>(__popcnt64(word));
+    #else
+        word = word - ((word >> 1) & 0x5555555555555555ull);
+        word = (word & 0x3333333333333333ull) + ((word >> 2) & 0x3333333333333333ull);
+        word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+        return static_cast<unsigned>((word * 0x0101010101010101ull) >> 56);
+    #endif
+    }
+
+    /** \brief Hints the CPU to load the cache line at p for reading. Never faults, p may be anything. */
+    inline void prefetch(const void* p)
+    {
+    #if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(p, 0, 3);
+    #elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        _mm_prefetch(static_cast<const char*>(p), _MM_HINT_T0);
+    #else
+        (void)p;
+    #endif
+    }
+
+    /**
+    * \brief Interface for the memory that component pools, metadata and entity records are taken from.
+    * Mirrors std::pmr::memory_resource, but works with c++14. Implement it to put a whole universe
+    * into an arena and drop that arena at once.
+    */
+    class MemoryResource
+    {
+    public:
+        virtual void* allocate(std::size_t bytes, std::size_t alignment) = 0;
+        virtual void deallocate(void* p, std::size_t bytes, std::size_t alignment) = 0;
+        virtual ~MemoryResource() {}
+    };
+
+    /** \brief The default MemoryResource, uses the global operator new and delete. */
+    class NewDeleteResource : public MemoryResource
+    {
+    public:
+        virtual void* allocate(std::size_t bytes, std::size_t alignment) override;
+        virtual void deallocate(void* p, std::size_t bytes, std::size_t alignment) override;
+    };
+
+    /** \brief Returns the process wide NewDeleteResource. */
+    MemoryResource* defaultResource();
+
+    /** \brief An allocator for standard containers that forwards to a MemoryResource. */
+    template<typename T>
+    class ResourceAllocator
+    {
+    template<typename U> friend class ResourceAllocator;
+    public:
+        using value_type = T;
+        //memory moves together with the resource it came from
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+
+        ResourceAllocator() : mResource(defaultResource()) {}
+        ResourceAllocator(MemoryResource* resource) : mResource(resource) {}
+        template<typename U>
+        ResourceAllocator(const ResourceAllocator<U>& other) : mResource(other.mResource) {}
+
+        T* allocate(std::size_t n) { return static_cast<T*>(mResource->allocate(n*sizeof(T), alignof(T))); }
+        void deallocate(T* p, std::size_t n) { mResource->deallocate(p, n*sizeof(T), alignof(T)); }
+
+        MemoryResource* resource() const { return mResource; }
+
+        template<typename U>
+        bool operator==(const ResourceAllocator<U>& other) const { return mResource == other.mResource; }
+        template<typename U>
+        bool operator!=(const ResourceAllocator<U>& other) const { return mResource != other.mResource; }
+
+    private:
+        MemoryResource* mResource;
+    };
+
+    /** \brief Deleter for objects that were constructed in memory of a MemoryResource. */
+    template<typename T>
+    struct ResourceDeleter
+    {
+        MemoryResource* resource;
+
+        void operator()(T* p) const
+        {
+            p->~T();
+            resource->deallocate(p, sizeof(T), alignof(T));
+        }
+    };
+
+    template<typename T>
+    using ResourcePtr = std::unique_ptr<T, ResourceDeleter<T>>;
+
+#ifdef DOM_HAS_PMR
+    /** \brief Adapts a std::pmr::memory_resource (e.g. a std::pmr::monotonic_buffer_resource) to a MemoryResource. */
+    class PmrResource : public MemoryResource
+    {
+    public:
+        explicit PmrResource(std::pmr::memory_resource* upstream) : mUpstream(upstream) {}
+
+        virtual void* allocate(std::size_t bytes, std::size_t alignment) override { return mUpstream->allocate(bytes, alignment); }
+        virtual void deallocate(void* p, std::size_t bytes, std::size_t alignment) override { mUpstream->deallocate(p, bytes, alignment); }
+
+    private:
+        std::pmr::memory_resource* mUpstream;
+    };
+#endif
+
+    /** \brief Kind of pages that back a VirtualRange. */
+    enum class HugePages
+    {
+        NONE,
+        TRANSPARENT, ///<madvise(MADV_HUGEPAGE), the kernel decides
+        EXPLICIT     ///<MAP_HUGETLB, falls back to normal pages if none are available
+    };
+
+    /**
+    * \brief A range of reserved address space whose pages are committed and given back piece by piece.
+    * Nothing inside is accessible before it is committed. Without mmap the whole range is allocated
+    * on reserve and commit/decommit do nothing.
+    */
+    class VirtualRange
+    {
+    public:
+        VirtualRange() : mReservation(nullptr), mReservationSize(0), mBase(nullptr), mSize(0) {}
+
+        VirtualRange(const VirtualRange&) = delete;
+        VirtualRange& operator=(const VirtualRange&) = delete;
+
+        /** \brief Reserves bytes of address space starting at a multiple of alignment. Throws std::bad_alloc on failure. */
+        void reserve(std::size_t bytes, std::size_t alignment);
+
+        /** \brief Makes [p, p+bytes) accessible. p must lie on a page boundary. Throws std::bad_alloc on failure. */
+        void commit(char* p, std::size_t bytes, HugePages hugePages = HugePages::NONE);
+
+        /** \brief Returns the pages of [p, p+bytes) to the OS and makes them inaccessible again. */
+        void decommit(char* p, std::size_t bytes);
+
+        char* base() const { return mBase; }
+        std::size_t size() const { return mSize; }
+
+        /** \brief Returns the granularity of commit and decommit. */
+        static std::size_t pageSize();
+
+        ~VirtualRange();
+
+    private:
+        char* mReservation;
+        std::size_t mReservationSize;
+        char* mBase;
+        std::size_t mSize;
+    };
+
+#ifdef DOM_HAS_MMAP
+    /**
+    * \brief A MemoryResource for the blocks of component pools. Reserves one large virtual range up
+    * front and commits the blocks one after another inside it, so the blocks of a pool really lie
+    * next to each other. The range can be backed by transparent huge pages (madvise(MADV_HUGEPAGE))
+    * or by explicit huge pages (MAP_HUGETLB, falls back to normal pages if none are available).
+    * With explicit huge pages every allocation is rounded up to HUGE_PAGE_SIZE, so choose the block
+    * size of the pool accordingly.
+    * Freed blocks are returned to the OS and their address range is reused for the next block of
+    * the same size. Meant for a single pool, see Universe::setBlockResource.
+    */
+    class MappedBlockResource : public MemoryResource
+    {
+    public:
+        using HugePages = dom::HugePages;
+
+        static constexpr std::size_t HUGE_PAGE_SIZE = std::size_t(2) << 20;
+
+        /** \brief Reserves (but does not commit) reserveBytes of address space. Throws std::bad_alloc on failure. */
+        explicit MappedBlockResource(std::size_t reserveBytes, HugePages hugePages = HugePages::TRANSPARENT);
+
+        MappedBlockResource(const MappedBlockResource&) = delete;
+        MappedBlockResource& operator=(const MappedBlockResource&) = delete;
+
+        virtual void* allocate(std::size_t bytes, std::size_t alignment) override;
+        virtual void deallocate(void* p, std::size_t bytes, std::size_t alignment) override;
+
+        /** \brief Returns the number of bytes between the start of the range and the end of the highest block. */
+        std::size_t used() const { return static_cast<std::size_t>(mTop - mBase); }
+
+        virtual ~MappedBlockResource();
+
+    private:
+        VirtualRange mRange;
+        char* mBase; ///<start of the usable range, aligned to HUGE_PAGE_SIZE
+        char* mEnd;
+        char* mTop;  ///<end of the highest committed block
+        std::size_t mGranularity;
+        HugePages mHugePages;
+        std::vector< std::pair<char*, std::size_t> > mFreeRanges; ///<committed ranges below mTop that were given back
+
+        std::size_t roundUp(std::size_t bytes) const { return (bytes + mGranularity - 1) / mGranularity * mGranularity; }
+    };
+
+    /**
+    * \brief A MemoryResource that places its memory on one NUMA node. Every allocation of at least a
+    * page is mapped on its own and bound to the node with mbind before anything touches it, smaller
+    * ones (bookkeeping) come from the upstream resource. Where mbind is not available (not Linux, or a
+    * kernel without NUMA support) the pages are placed by first touch, so allocate from a thread that
+    * is pinned to the node then.
+    * Use it for single pools (Universe::setBlockResource) or give each partition of a simulation its
+    * own universe on the resource of the node whose workers process that partition.
+    */
+    class NumaBlockResource : public MemoryResource
+    {
+    public:
+        /** \brief With strict == false the node is only preferred and other nodes are used once it is full,
+        * with strict == true the memory is bound to the node. */
+        explicit NumaBlockResource(int node, bool strict = false, MemoryResource* upstream = defaultResource())
+            : mNode(node), mStrict(strict), mBound(false), mUpstream(upstream) {}
+
+        NumaBlockResource(const NumaBlockResource&) = delete;
+        NumaBlockResource& operator=(const NumaBlockResource&) = delete;
+
+        virtual void* allocate(std::size_t bytes, std::size_t alignment) override;
+        virtual void deallocate(void* p, std::size_t bytes, std::size_t alignment) override;
+
+        int node() const { return mNode; }
+
+        /** \brief True if the last mapped allocation was bound to the node, false if first touch decides. */
+        bool bound() const { return mBound; }
+
+        /** \brief Returns the node of the CPU the calling thread runs on, or -1 if it is unknown. */
+        static int currentNode();
+
+    private:
+        static constexpr int MPOL_PREFERRED_MODE = 1; ///<values of linux/mempolicy.h
+        static constexpr int MPOL_BIND_MODE = 2;
+        static constexpr std::size_t NODE_WORDS = 16; ///<the node mask covers 1024 nodes
+
+        int mNode;
+        bool mStrict;
+        bool mBound;
+        MemoryResource* mUpstream;
+
+        /** \brief True if an allocation is mapped by this resource instead of coming from mUpstream. */
+        static bool mapped(std::size_t bytes, std::size_t alignment)
+        {
+            return bytes >= VirtualRange::pageSize() && alignment <= VirtualRange::pageSize();
+        }
+    };
+#endif
+
     /** \brief A handle object to access an element in the ChunkedArray.
     * Works with double indexing (block,index). */
     struct ChunkedArrayHandle
@@ -75,40 +374,149 @@ namespace dom
         explicit operator bool() const { return *this != null(); }
     };
 
+    /**
+    * \brief A run of count neighbouring slots in one block of a ChunkedArray, starting at index first.
+    */
+    struct ChunkedArrayRange
+    {
+        SubID block;
+        SubID first;
+        SubID count;
+
+        ChunkedArrayRange() {}
+        ChunkedArrayRange(SubID b, SubID f, SubID c) : block(b), first(f), count(c) {}
+
+        /** \brief Returns the handle of the i-th slot of the range. */
+        ChunkedArrayHandle handle(std::size_t i) const { return ChunkedArrayHandle(block, first + i); }
+    };
+
+    using ChunkedArrayRangeVector = std::vector< ChunkedArrayRange, ResourceAllocator<ChunkedArrayRange> >;
+
+    /** \brief The references to the handles of the elements that compact may move. */
+    using HandleRefVector = std::vector< ChunkedArrayHandle*, ResourceAllocator<ChunkedArrayHandle*> >;
+
+    /** \brief Decides which free slot a ChunkedArray hands out next. */
+    enum class ReusePolicy
+    {
+        FREE_ORDER,   ///<reuse slots in the order they were freed (see REUSE_C)
+        LOWEST_BLOCK, ///<reuse free slots of the block with the lowest index first
+        FULLEST_BLOCK ///<reuse free slots of the block that holds the most elements first
+    };
+
     class BaseChunkedArray
     {
     public:  virtual void destroy(ChunkedArrayHandle h) = 0;
+             virtual void clear() = 0;
+             virtual std::size_t compact(HandleRefVector& refs, std::size_t budget) = 0;
+             virtual std::size_t trim() = 0;
+             virtual ~BaseChunkedArray() {}
+    };
+
+    /** \brief Deleter for pools that were constructed in memory of a MemoryResource and are held
+    * by their BaseChunkedArray. Remembers the size of the pool type. */
+    struct PoolDeleter
+    {
+        MemoryResource* resource;
+        std::size_t bytes;
+        std::size_t alignment;
+
+        void operator()(BaseChunkedArray* p) const
+        {
+            p->~BaseChunkedArray();
+            resource->deallocate(p, bytes, alignment);
+        }
     };
 
     /**
     * \brief A datastructure that stores its elements in semi-continous memory.
     * Elements are arranged in memory-blocks of a fixed size. The datastructure attempts
-    * to place that memory blocks close together.
+    * to place that memory blocks close together; with a MappedBlockResource as block resource
+    * they are placed right after each other.
     * Add and destroy operations are cheap and wont require reallocation.
-    * Note that destruction of the objects in the ChunkedArray cant be done by the
+    * Every block keeps an occupancy bitmap (one bit per slot), so the live elements
+    * can be visited in address order with forEach or begin/end.
+    * Note that destruction of the objects in the ChunkedArray is not done by the
     * array itself. The user must take care of destroying all created objects itself
-    * by call destroy(handle). The reason behind this is, that the array does not hold an
-    * list of the slots with constructed object in itself. But the user of the array should
-    * have.
+    * by call destroy(handle).
     * Template types:
     * T ... Type of the object to be stored
     * BLOCK_SIZE ... number of objects with type T, that can be stored in a continous block
     * REUSE_C ... minimum stack-size for free slots. Choose value > 0 only if you want to
     * avoid, that single slots are reused too often.
+    * ALIGNMENT ... alignment of every element, at least alignof(T). Elements are padded to a
+    * multiple of it, so with ALIGNMENT == CACHE_LINE_SIZE no element spans two cache lines.
+    * Blocks are always aligned to CACHE_LINE_SIZE or ALIGNMENT, whatever is larger.
+    * MAX_BLOCKS ... if > 0, the array is flat: it reserves address space for MAX_BLOCKS blocks on
+    * the first add and commits the pages of a block only when the block is opened. Block b then always
+    * lives at the same offset from one base address, so get() is a multiply-add on the handle without
+    * loading the block table, and trimmed blocks come back at the same address. Adding beyond
+    * MAX_BLOCKS blocks throws std::bad_alloc. Flat arrays ignore setBlockResource().
+    *
+    * Free slots are chained through the dead slots themselves, so add and destroy never allocate.
+    * With REUSE_C == 0 the list is a stack and the most recently freed slot is reused first.
+    * With REUSE_C > 0 it is a queue, so a freed slot is only reused after all slots freed before it.
+    * The block-aware reuse policies keep one list per block instead and refill the lowest or the
+    * fullest block first, so the elements stay packed in few blocks after churn.
+    * No block is allocated before the first element is added.
+    * Blocks that run empty keep their memory until trim() is called.
+    * All memory is taken from the MemoryResource given on construction.
     */
-    template<typename T, std::size_t BLOCK_SIZE = 8192, std::size_t REUSE_C = 0>
-    class ChunkedArray : public BaseChunkedArray
+    template<typename T, std::size_t BLOCK_SIZE = DEFAULT_BLOCK_SIZE, std::size_t REUSE_C = 0, std::size_t ALIGNMENT = alignof(T), std::size_t MAX_BLOCKS = 0>
+    class ChunkedArray final : public BaseChunkedArray
     {
+        static_assert(BLOCK_SIZE > 0 && BLOCK_SIZE < std::numeric_limits<SubID>::max(), "BLOCK_SIZE must fit into a SubID.");
+        static_assert(ALIGNMENT >= alignof(T), "ALIGNMENT must not be weaker than the alignment of T.");
+        static_assert((ALIGNMENT & (ALIGNMENT - 1)) == 0, "ALIGNMENT must be a power of two.");
+        static_assert(MAX_BLOCKS <= std::size_t(std::numeric_limits<SubID>::max()) + 1, "MAX_BLOCKS must not exceed the block ids of a SubID.");
+
     private:
         class MemoryBlock;
 
-        std::allocator<T> alloc;
-        std::vector< MemoryBlock > mBlocks;
-        std::queue<ChunkedArrayHandle> mFreeSlots;
+        static constexpr std::size_t WORD_BITS = 64;
+        static constexpr std::size_t WORD_COUNT = (BLOCK_SIZE + WORD_BITS - 1) / WORD_BITS; ///<occupancy words per block
+
+        /** \brief Raw storage of one element. A dead slot holds the handle of the next free slot instead,
+        * so the slot is padded to the size of a handle for tiny types. */
+        struct Slot
+        {
+            alignas(ALIGNMENT) unsigned char bytes[sizeof(T) > sizeof(ChunkedArrayHandle) ? sizeof(T) : sizeof(ChunkedArrayHandle)];
+        };
+
+        static constexpr std::size_t BLOCK_ALIGNMENT = alignof(Slot) > CACHE_LINE_SIZE ? alignof(Slot) : CACHE_LINE_SIZE;
+        static constexpr std::size_t BLOCK_BYTES = BLOCK_SIZE*sizeof(Slot);
+        static constexpr std::size_t FLAT_STRIDE = (BLOCK_BYTES + MAX_PAGE_SIZE - 1) / MAX_PAGE_SIZE * MAX_PAGE_SIZE; ///<distance of two blocks in a flat array
+        static constexpr std::size_t NO_BLOCK = std::numeric_limits<std::size_t>::max();
+        static constexpr SubID NULL_INDEX = std::numeric_limits<SubID>::max();
+
+        using BlockVector = std::vector< MemoryBlock, ResourceAllocator<MemoryBlock> >;
+
+        MemoryResource* mResource;
+        MemoryResource* mBlockResource; ///<the element blocks come from here, everything else from mResource
+        BlockVector mBlocks;
+        ReusePolicy mPolicy;
+        ChunkedArrayHandle mFreeHead; ///<next free slot to reuse, only used by ReusePolicy::FREE_ORDER
+        ChunkedArrayHandle mFreeTail; ///<most recently freed slot, only used in queue mode
+        std::size_t mFreeBlock; ///<block to reuse slots from, only used by the block-aware policies
+        std::size_t mFreeCount;
+        std::size_t mCurrentBlock; ///<block that hands out fresh slots
+        std::size_t mReleasedCount; ///<number of blocks without memory
+        std::size_t mIdleCount; ///<number of blocks besides mCurrentBlock with memory, but without any used slot (endIndex == 0)
+        VirtualRange mRange; ///<address space of all blocks, only used if MAX_BLOCKS > 0
 
     public:
-        /** \brief Constructs a new array with a single block allocated. */
-        ChunkedArray();
+        template<typename VALUE, typename BLOCKS>
+        class BasicIterator;
+
+        using iterator = BasicIterator<T, BlockVector>;
+        using const_iterator = BasicIterator<const T, const BlockVector>;
+        using reference = T&;
+        using const_reference = const T&;
+
+        /** \brief Constructs an empty array. No block is allocated before the first add or reserve. */
+        explicit ChunkedArray(MemoryResource* resource = defaultResource());
+
+        ChunkedArray(const ChunkedArray&) = delete;
+        ChunkedArray& operator=(const ChunkedArray&) = delete;
 
         /**
         * \brief Adds a new element and constructs it in place. This may
@@ -117,110 +525,953 @@ namespace dom
         template<typename ...PARAM>
         ChunkedArrayHandle add(PARAM&&... param);
 
+        /**
+        * \brief Adds n new elements, each constructed from param..., and returns the slots they went to
+        * as ranges of neighbouring slots. The fresh tail of the current block is filled first, then
+        * free slots (neighbouring free slots are merged into one range), then new blocks, so a big batch
+        * ends up in few long ranges and the elements of a fresh range are constructed in one tight loop.
+        * If the array is empty and REUSE_C == 0, all its blocks count as fresh again. With REUSE_C > 0
+        * freed slots are held back like in add, so stale handles are not reused right away.
+        */
+        template<typename ...PARAM>
+        ChunkedArrayRangeVector addN(std::size_t n, const PARAM&... param);
+
         /**
         * \brief Accesses an element through an ChunkedArrayHandle.
         */
         T& get(ChunkedArrayHandle h);
         const T& get(ChunkedArrayHandle h) const;
 
+        /** \brief Starts loading the element at h into the cache, see dom::prefetch. */
+        void prefetch(ChunkedArrayHandle h) const { dom::prefetch(&get(h)); }
+
         /**
         * \brief Destroys an element through an ChunkedArrayHandle.
         */
         virtual void destroy(ChunkedArrayHandle h) override;
 
+        /**
+        * \brief Destroys count elements through their handles. Calls from the outside go through
+        * one (indirect) call for the whole batch, the elements are destroyed without further dispatch.
+        */
+        void destroyMany(const ChunkedArrayHandle* handles, std::size_t count);
+
+        /**
+        * \brief Destroys all elements. Afterwards the blocks hand out fresh slots from their start again,
+        * the memory is kept until trim(). For trivially destructible T no element is touched, the blocks
+        * are just reset.
+        */
+        virtual void clear() override;
+
+        /** \brief Destroys all elements of a range, e.g. one returned by addN. All slots must be alive. */
+        void destroyN(const ChunkedArrayRange& range);
+        void destroyN(const ChunkedArrayRangeVector& ranges);
+
         /** \brief Returns the number of memory blocks currently allocated. */
         std::size_t blockCount() const;
 
+        /**
+        * \brief Allocates blocks until n elements fit into the array without allocating on add.
+        * The new blocks stay unused until the allocated ones are full, trim() releases them again.
+        */
+        void reserve(std::size_t n);
+
+        /** \brief Returns the number of elements the array can hold without allocating a block. */
+        std::size_t capacity() const;
+
+        /** \brief Returns one past the highest slot position block*BLOCK_SIZE + index the array can hand
+        * out without appending a block. */
+        std::size_t slotCount() const { return mBlocks.size()*BLOCK_SIZE; }
+
+        /** \brief Returns one past the highest slot of block b that was handed out since the block was opened. */
+        std::size_t blockEnd(std::size_t b) const { return mBlocks[b].endIndex; }
+
+        /**
+        * \brief Returns the memory of all blocks that hold no elements anymore. Handles to live
+        * elements stay valid, the free slots of the released blocks are dropped.
+        * Returns the number of released blocks.
+        */
+        virtual std::size_t trim() override;
+
         /** \brief Returns the number of elements in the list. */
         std::size_t size() const;
 
+        /** \brief Returns true if the slot the handle points to holds a constructed element. */
+        bool alive(ChunkedArrayHandle h) const;
+
+        /**
+        * \brief Moves elements from the highest positions into the lowest free slots.
+        * refs holds pointers to the handles of all elements that may be moved, elements without
+        * such a reference stay where they are. The handle of a moved element is rewritten in place.
+        * At most budget elements are moved, afterwards empty blocks are released.
+        * The free list is rebuilt in address order afterwards, so with REUSE_C > 0 the order in which
+        * the remaining slots were freed is lost and the lowest one is reused first.
+        * Returns the number of moved elements. A result smaller than budget means that no element
+        * of refs can move any further.
+        */
+        virtual std::size_t compact(HandleRefVector& refs, std::size_t budget) override;
+
+        /**
+        * \brief Selects the order in which free slots are reused. Switching rebuilds the free
+        * list in address order, so pending slots are reused lowest address first afterwards and
+        * with REUSE_C > 0 the order in which they were freed is lost. Setting the current policy
+        * again keeps the list as it is.
+        */
+        void setReusePolicy(ReusePolicy policy);
+        ReusePolicy getReusePolicy() const { return mPolicy; }
+
+        /**
+        * \brief Takes the element blocks from the given resource from now on, e.g. a MappedBlockResource.
+        * The bookkeeping stays with the resource given on construction.
+        * The array must be empty, throws std::logic_error otherwise.
+        */
+        void setBlockResource(MemoryResource* resource);
+
+        /**
+        * \brief Calls f(T&) for every live element in address order. Empty 64-slot words
+        * are skipped without touching the element memory.
+        * f must not add or destroy elements of this array.
+        */
+        template<typename F>
+        void forEach(F f);
+        template<typename F>
+        void forEach(F f) const;
+
+        /** \brief Iterators over the live elements in address order. The handle of the current
+        * element is available through it.handle(). Destroying the current element is allowed, adding
+        * elements invalidates iterators. */
+        iterator begin();
+        iterator end();
+        const_iterator begin() const;
+        const_iterator end() const;
+
         ~ChunkedArray();
 
     private:
+        /** \brief Appends a freed slot to the intrusive free list. */
+        void pushFree(ChunkedArrayHandle h);
+
+        /** \brief Takes the next slot from the intrusive free list. The list must not be empty. */
+        ChunkedArrayHandle popFree();
+
+        ChunkedArrayHandle readLink(ChunkedArrayHandle h) const;
+        void writeLink(ChunkedArrayHandle h, ChunkedArrayHandle next);
+
+        /** \brief True if block candidate should be refilled before block current. */
+        bool preferBlock(std::size_t candidate, std::size_t current) const;
+
+        /** \brief Points mFreeBlock to the block the policy wants to refill next. */
+        void selectFreeBlock();
+
+        /** \brief Relinks all dead slots below the end indices, derived from the occupancy bitmaps. */
+        void rebuildFreeList();
+
+        /** \brief Unlinks the free slots of all blocks without elements, so they can be released.
+        * The remaining free slots keep their order. */
+        void unlinkEmptyBlocks();
+
+        /** \brief Returns the lowest dead slot at or after the cursor (block, word) and advances the cursor to it. */
+        ChunkedArrayHandle nextHole(std::size_t& block, std::size_t& word) const;
+
+        /** \brief Move-constructs the element at from into the dead slot to and destroys the source.
+        * Leaves the free lists untouched. */
+        void relocate(ChunkedArrayHandle from, ChunkedArrayHandle to);
+
+        /** \brief Deallocates all blocks without elements. Returns the number of released blocks. */
+        std::size_t releaseEmptyBlocks();
+
+        /** \brief Returns the memory for block b. */
+        Slot* allocateBlock(std::size_t b);
+        void deallocateBlock(Slot* ptr);
+
+        /** \brief Makes mCurrentBlock a block with memory and fresh slots. Prefers idle and released
+        * blocks over appending a new one. */
+        void openBlock();
+
+        /** \brief Appends a block with memory. If the allocation throws, the block list stays as it was.
+        * Throws std::length_error if the new block id would not fit into a SubID. */
+        void appendBlock();
+
+        /** \brief Turns all blocks into idle blocks and drops the free lists. Only valid while the array
+        * is empty; afterwards adds hand out fresh slots in address order instead of walking the free list. */
+        void rewind();
+
+        /** \brief Sets (value == true) or clears the occupancy bits of count slots from first on. */
+        void markRange(MemoryBlock& block, std::size_t first, std::size_t count, bool value);
+
+        /** \brief Constructs count elements from first on in dead slots of block b and marks them alive. */
+        template<typename ...PARAM>
+        void constructRange(std::size_t b, std::size_t first, std::size_t count, const PARAM&... param);
+
         class MemoryBlock
         {
-        friend class ChunkedArray<T, BLOCK_SIZE, REUSE_C>;
+        friend class ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>;
         private:
             std::size_t contentCount;
             std::size_t endIndex;  //one index past the last occupied index
-            T* ptr;
+            Slot* ptr;
+            std::array<uint64_t, WORD_COUNT> occupancy; //bit i is set if slot i holds a constructed element
+            SubID freeHead; //first slot of the per-block free list
+
+        public:
+            MemoryBlock() : contentCount(0), endIndex(0), ptr(nullptr), freeHead(NULL_INDEX) { occupancy.fill(0); }
 
+            T* at(std::size_t i) const { return reinterpret_cast<T*>(ptr + i); }
+
+            /** \brief Number of occupancy words that can contain set bits. */
+            std::size_t usedWords() const { return (endIndex + WORD_BITS - 1) / WORD_BITS; }
+        };
+
+    public:
+        /**
+        * \brief Forward iterator over the live slots. Walks the occupancy words of each block and
+        * uses countTrailingZeros to jump from one set bit to the next.
+        */
+        template<typename VALUE, typename BLOCKS>
+        class BasicIterator
+        {
+        friend class ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>;
         public:
-            MemoryBlock() : contentCount(0), endIndex(0), ptr(nullptr) {}
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = typename std::remove_const<VALUE>::type;
+            using difference_type = std::ptrdiff_t;
+            using pointer = VALUE*;
+            using reference = VALUE&;
+
+            BasicIterator() : mBlocks(nullptr), mBlock(0), mWord(0), mBits(0) {}
+
+            reference operator*() const { return *(*mBlocks)[mBlock].at(mWord*WORD_BITS + countTrailingZeros(mBits)); }
+            pointer operator->() const { return &**this; }
+
+            BasicIterator& operator++()
+            {
+                mBits &= mBits - 1; //clear the lowest set bit
+                skipEmpty();
+                return *this;
+            }
+
+            BasicIterator operator++(int) { BasicIterator tmp = *this; ++*this; return tmp; }
+
+            bool operator==(const BasicIterator& other) const { return mBlock == other.mBlock && mWord == other.mWord && mBits == other.mBits; }
+            bool operator!=(const BasicIterator& other) const { return !(*this == other); }
+
+            /** \brief Returns the handle of the element the iterator points to. */
+            ChunkedArrayHandle handle() const { return ChunkedArrayHandle(mBlock, mWord*WORD_BITS + countTrailingZeros(mBits)); }
+
+        private:
+            BLOCKS* mBlocks;
+            std::size_t mBlock;
+            std::size_t mWord;
+            uint64_t mBits; //remaining set bits of the current word
+
+            BasicIterator(BLOCKS* blocks, std::size_t block) : mBlocks(blocks), mBlock(block), mWord(0), mBits(0)
+            {
+                if (mBlock < mBlocks->size())
+                {
+                    mBits = (*mBlocks)[mBlock].occupancy[0];
+                    skipEmpty();
+                }
+            }
+
+            //moves forward until mBits holds a set bit or the end is reached
+            void skipEmpty()
+            {
+                while (!mBits)
+                {
+                    if (++mWord >= (*mBlocks)[mBlock].usedWords())
+                    {
+                        mWord = 0;
+                        do { ++mBlock; } while (mBlock < mBlocks->size() && (*mBlocks)[mBlock].contentCount == 0);
+                        if (mBlock >= mBlocks->size())
+                            return;
+                    }
+                    mBits = (*mBlocks)[mBlock].occupancy[mWord];
+                }
+            }
         };
     };
 
+    /** \brief Stores a component as a whole, one struct after the other (array of structs). The default. */
+    struct AoSLayout {};
 
-    /**
-    * \brief A base class for all component base structs.
-    * CINDEX is a index type for components, rather small. COMP_TOTAL is the total number of components allowed.
-    */
-    template<typename CINDEX = unsigned short, CINDEX COMP_TOTAL = DEFAULT_COMPONENT_COUNT>
-    struct ComponentTraitsBase
+    /** \brief Stores a component as a whole in one dense array without holes, see PackedArray. */
+    struct PackedLayout {};
+
+    /** \brief Names the data member MEMBER of type F of a component C, e.g. SoAField<Position, float, &Position::x>. */
+    template<typename C, typename F, F C::* MEMBER>
+    struct SoAField
     {
-    protected:
-        /** \brief Returns a new, unique ID for a component-type, but doesnt give
-        * more than COMP_TOTAL different IDs. */
-        static CINDEX newID();
+        static_assert(alignof(F) <= CACHE_LINE_SIZE, "SoA fields are aligned to at most CACHE_LINE_SIZE.");
+
+        using Type = F;
+
+        static F& of(C& c) { return c.*MEMBER; }
+        static const F& of(const C& c) { return c.*MEMBER; }
     };
 
     /**
-    * \brief A traits class for a specific component type C.
-    * Provides a unique ID for that type.
-    * Throws an exception, if a new ID is requested, when there are already
-    * COMP_TOTAL different component-types registered.
+    * \brief Stores a component as one array per listed SoAField (structure of arrays), see SoAChunkedArray.
+    * The fields together must hold the whole state of the component.
     */
-    template<typename C, typename CINDEX = unsigned short, CINDEX COMP_TOTAL = DEFAULT_COMPONENT_COUNT>
-    struct ComponentTraits : public ComponentTraitsBase<CINDEX, COMP_TOTAL>
+    template<typename ... FIELDS>
+    struct SoALayout
     {
-    public:
-        static CINDEX getID();
+        static constexpr std::size_t FIELD_COUNT = sizeof...(FIELDS);
+
+        template<std::size_t I>
+        using Field = typename std::tuple_element< I, std::tuple<FIELDS...> >::type;
+
+        /** \brief Byte offset of the array of field in a block of blockSize elements. Every array starts on a cache line. */
+        static constexpr std::size_t offset(std::size_t field, std::size_t blockSize)
+        {
+            const std::size_t sizes[] = { sizeof(typename FIELDS::Type)..., 0 };
+            std::size_t bytes = 0;
+            for (std::size_t i = 0; i < field; ++i)
+                bytes += (sizes[i]*blockSize + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+            return bytes;
+        }
     };
 
     /**
-    * \brief An error thrown by ComponentTraitsBase, if there are more then
-    * COMP_TOTAL ids requested.
+    * \brief A ChunkedArray that stores its elements field by field. Every block holds one array per
+    * field of LAYOUT (a SoALayout), so a kernel that reads only Position::x streams nothing but x values
+    * and can load the values of several elements with one vector instruction, see forEachBlock.
+    * Since an element never exists as a whole, get returns a proxy (reference, const_reference):
+    * ref.field<I>() accesses a single field, converting to C gathers all fields and assigning a C
+    * scatters them. C must be default constructible and trivially destructible.
+    * Free lists, occupancy and reuse policies are those of an inner ChunkedArray, whose slots only
+    * carry the free list link (the size of a handle per element).
     */
-    struct ComponentCountError : public std::runtime_error
+    template<typename C, typename LAYOUT, std::size_t BLOCK_SIZE = DEFAULT_BLOCK_SIZE, std::size_t REUSE_C = 0>
+    class SoAChunkedArray final : public BaseChunkedArray
     {
-        ComponentCountError();
-    };
+        static_assert(LAYOUT::FIELD_COUNT > 0, "A SoALayout needs at least one field.");
+        static_assert(std::is_default_constructible<C>::value, "SoA elements are assembled from their fields and must be default constructible.");
+        static_assert(std::is_trivially_destructible<C>::value, "SoA elements are never stored as a whole, so their destructor would never run.");
 
+    public:
+        template<std::size_t I>
+        using FieldType = typename LAYOUT::template Field<I>::Type;
 
+        template<bool CONST>
+        class BasicReference;
 
-    using EntityArrayHandle = ChunkedArrayHandle;
-    using ComponentHandle = ChunkedArrayHandle;
+        using reference = BasicReference<false>;
+        using const_reference = BasicReference<true>;
 
-    template<typename CINDEX, CINDEX COMP_TOTAL> class EntityData;
-    template<typename CINDEX, CINDEX COMP_TOTAL> class Universe;
-    template<typename C> class ComponentInstantiator;
+        class BlockView;
 
+        /** \brief Constructs an empty array, no block is allocated before the first add. */
+        explicit SoAChunkedArray(MemoryResource* resource = defaultResource());
 
-    /**
-    * \brief A helper class for components that can be attached multiple times to an entity.
-    * The component set is implemented as a vector and the components can be accessed by index.
-    * Note that MultiComponent-sets must not persist continously in memory,
-    * but the chances are good that they are.
-    */
-    template<typename C, typename CINDEX = unsigned short, CINDEX COMP_TOTAL = DEFAULT_COMPONENT_COUNT>
-    class MultiComponent
-    {
-    private:
-        std::vector<ComponentHandle> mHandles;
-        Universe<CINDEX, COMP_TOTAL>* mUniverse; //the universe that holds this component, needed for correct destruction
+        SoAChunkedArray(const SoAChunkedArray&) = delete;
+        SoAChunkedArray& operator=(const SoAChunkedArray&) = delete;
 
-    public:
-        template<typename ... PARAM>
-        MultiComponent(std::size_t num, Universe<CINDEX, COMP_TOTAL>& universe, PARAM&& ... param);
+        /** \brief Adds a new element constructed from param... and scatters it into the field arrays. */
+        template<typename ...PARAM>
+        ChunkedArrayHandle add(PARAM&&... param);
 
-        MultiComponent();
+        /** \brief Adds n elements constructed from param..., see ChunkedArray::addN. Each field array is filled in one loop. */
+        template<typename ...PARAM>
+        ChunkedArrayRangeVector addN(std::size_t n, const PARAM&... param);
 
-        template<typename ... PARAM>
-        void init(std::size_t num, Universe<CINDEX, COMP_TOTAL>& universe, PARAM&& ... param);
+        /** \brief Accesses an element through a proxy. */
+        reference get(ChunkedArrayHandle h);
+        const_reference get(ChunkedArrayHandle h) const;
 
-        C& getComponent(std::size_t index);
-        const C& getComponent(std::size_t index) const;
-        std::size_t getComponentCount() const;
+        /** \brief Starts loading all fields of the element at h into the cache. */
+        void prefetch(ChunkedArrayHandle h) const;
+
+        virtual void destroy(ChunkedArrayHandle h) override;
+        void destroyMany(const ChunkedArrayHandle* handles, std::size_t count);
+        virtual void clear() override;
+
+        /** \brief Returns the memory of all blocks without elements, see ChunkedArray::trim. */
+        virtual std::size_t trim() override;
+
+        /** \brief Moves elements into lower free slots like ChunkedArray::compact and moves their fields along. */
+        virtual std::size_t compact(HandleRefVector& refs, std::size_t budget) override;
+
+        /** \brief Allocates blocks until n elements fit into the array without allocating on add. */
+        void reserve(std::size_t n);
+
+        std::size_t blockCount() const { return mRows.blockCount(); }
+        std::size_t capacity() const { return mRows.capacity(); }
+        std::size_t size() const { return mRows.size(); }
+        bool alive(ChunkedArrayHandle h) const { return mRows.alive(h); }
+
+        void setReusePolicy(ReusePolicy policy) { mRows.setReusePolicy(policy); }
+        ReusePolicy getReusePolicy() const { return mRows.getReusePolicy(); }
+
+        /** \brief Takes the field arrays from the given resource from now on. The array must be empty,
+        * throws std::logic_error otherwise. */
+        void setBlockResource(MemoryResource* resource);
+
+        /** \brief Calls f(reference) for every live element in address order. */
+        template<typename F>
+        void forEach(F f);
+        template<typename F>
+        void forEach(F f) const;
+
+        /**
+        * \brief Calls f(const BlockView&) for every block that holds elements. The field arrays of a
+        * block can be processed as a whole up to view.end(); dead slots in between hold stale values
+        * (or zeros), so a kernel that must not touch them checks alive(ChunkedArrayHandle(view.block(), i)).
+        */
+        template<typename F>
+        void forEachBlock(F f);
+
+        ~SoAChunkedArray();
+
+    private:
+        /** \brief Placeholder element of mRows, its slot only holds the free list link. */
+        struct Row {};
+
+        struct FieldBlock
+        {
+            char* data;
+            std::size_t count; ///<number of live elements
+        };
+
+        static constexpr std::size_t BLOCK_BYTES = LAYOUT::offset(LAYOUT::FIELD_COUNT, BLOCK_SIZE);
+
+        using Fields = std::make_index_sequence<LAYOUT::FIELD_COUNT>;
+
+        ChunkedArray<Row, BLOCK_SIZE, REUSE_C> mRows; ///<slot management; block b of mRows owns mFields[b]
+        MemoryResource* mBlockResource;
+        std::vector< FieldBlock, ResourceAllocator<FieldBlock> > mFields;
+
+        template<std::size_t I>
+        static FieldType<I>* fieldArray(char* data) { return reinterpret_cast<FieldType<I>*>(data + LAYOUT::offset(I, BLOCK_SIZE)); }
+
+        template<std::size_t ... I>
+        static void store(std::index_sequence<I...>, char* data, std::size_t first, std::size_t count, const C& value);
+
+        template<std::size_t ... I>
+        static void load(std::index_sequence<I...>, char* data, std::size_t index, C& value);
+
+        template<std::size_t ... I>
+        static void prefetch(std::index_sequence<I...>, char* data, std::size_t index);
+
+        /** \brief Returns the field arrays of block b and allocates them if needed. */
+        char* fieldBlock(std::size_t b);
+
+        /** \brief Deallocates the field arrays of all blocks without elements. */
+        void releaseEmptyFieldBlocks();
+
+    public:
+        /** \brief Proxy to one element. Copies of a proxy refer to the same element. */
+        template<bool CONST>
+        class BasicReference
+        {
+        friend class SoAChunkedArray<C, LAYOUT, BLOCK_SIZE, REUSE_C>;
+        template<bool> friend class BasicReference;
+        public:
+            /** \brief A const proxy can be made from a mutable one. */
+            BasicReference(const BasicReference<false>& other) : mData(other.mData), mIndex(other.mIndex) {}
+
+            template<std::size_t I>
+            typename std::conditional<CONST, const FieldType<I>&, FieldType<I>&>::type field() const { return fieldArray<I>(mData)[mIndex]; }
+
+            /** \brief Gathers all fields into a C. */
+            operator C() const
+            {
+                C value = C();
+                load(Fields(), mData, mIndex, value);
+                return value;
+            }
+
+            /** \brief Scatters the fields of value into the element. */
+            const BasicReference& operator=(const C& value) const
+            {
+                static_assert(!CONST, "Cannot assign through a const_reference.");
+                store(Fields(), mData, mIndex, 1, value);
+                return *this;
+            }
+
+            const BasicReference& operator=(const BasicReference& other) const { return *this = static_cast<C>(other); }
+
+        private:
+            char* mData;
+            std::size_t mIndex;
+
+            BasicReference(char* data, std::size_t index) : mData(data), mIndex(index) {}
+        };
+
+        /** \brief The field arrays of one block. */
+        class BlockView
+        {
+        friend class SoAChunkedArray<C, LAYOUT, BLOCK_SIZE, REUSE_C>;
+        public:
+            /** \brief Returns the array of field I, aligned to CACHE_LINE_SIZE. */
+            template<std::size_t I>
+            FieldType<I>* field() const { return fieldArray<I>(mData); }
+
+            std::size_t block() const { return mBlock; }
+
+            /** \brief One past the highest slot that was handed out in this block. */
+            std::size_t end() const { return mEnd; }
+
+        private:
+            char* mData;
+            std::size_t mBlock;
+            std::size_t mEnd;
+
+            BlockView(char* data, std::size_t block, std::size_t end) : mData(data), mBlock(block), mEnd(end) {}
+        };
+    };
+
+
+    /**
+    * \brief A component made of a hot part, used every frame, and a cold part that is rarely needed.
+    * The universe keeps the two parts in parallel pools that are indexed by the same handle
+    * (see SplitChunkedArray), so a scan over the hot parts never drags the cold bytes through the
+    * cache. get and modify return a proxy with hot() and cold().
+    */
+    template<typename HOT, typename COLD>
+    struct SplitComponent
+    {
+        using Hot = HOT;
+        using Cold = COLD;
+
+        HOT hot;
+        COLD cold;
+    };
+
+    /**
+    * \brief Stores SplitComponent<HOT, COLD> as two ChunkedArrays, one for each part. Both arrays see the
+    * same sequence of adds, destroys and moves, so an element has the same handle in both of them.
+    * get returns a proxy (reference, const_reference) that resolves hot() and cold() only when called.
+    * forEachHot streams the hot array alone at full ChunkedArray speed.
+    */
+    template<typename HOT, typename COLD, std::size_t BLOCK_SIZE = DEFAULT_BLOCK_SIZE, std::size_t REUSE_C = 0>
+    class SplitChunkedArray final : public BaseChunkedArray
+    {
+    public:
+        using HotArray = ChunkedArray<HOT, BLOCK_SIZE, REUSE_C>;
+        using ColdArray = ChunkedArray<COLD, BLOCK_SIZE, REUSE_C>;
+
+        template<bool CONST>
+        class BasicReference;
+
+        using reference = BasicReference<false>;
+        using const_reference = BasicReference<true>;
+
+        /** \brief Constructs an empty array, no block is allocated before the first add. */
+        explicit SplitChunkedArray(MemoryResource* resource = defaultResource());
+
+        SplitChunkedArray(const SplitChunkedArray&) = delete;
+        SplitChunkedArray& operator=(const SplitChunkedArray&) = delete;
+
+        /** \brief Adds an element with default constructed parts. */
+        ChunkedArrayHandle add();
+
+        /** \brief Adds an element whose parts are constructed from hot and cold. */
+        template<typename H, typename CD>
+        ChunkedArrayHandle add(H&& hot, CD&& cold);
+
+        /** \brief Adds a copy of the given element. */
+        ChunkedArrayHandle add(const SplitComponent<HOT, COLD>& value);
+        template<bool CONST>
+        ChunkedArrayHandle add(const BasicReference<CONST>& other);
+
+        /** \brief Adds n elements with default constructed parts, see ChunkedArray::addN. */
+        ChunkedArrayRangeVector addN(std::size_t n);
+
+        reference get(ChunkedArrayHandle h) { return reference(&mHot, &mCold, h); }
+        const_reference get(ChunkedArrayHandle h) const { return const_reference(&mHot, &mCold, h); }
+
+        /** \brief Starts loading the hot part of the element at h into the cache. */
+        void prefetch(ChunkedArrayHandle h) const { mHot.prefetch(h); }
+
+        virtual void destroy(ChunkedArrayHandle h) override;
+        void destroyMany(const ChunkedArrayHandle* handles, std::size_t count);
+        virtual void clear() override;
+
+        /** \brief Releases empty blocks of both arrays. Returns the number of released blocks in total. */
+        virtual std::size_t trim() override;
+
+        /** \brief Compacts both arrays in lockstep, see ChunkedArray::compact. */
+        virtual std::size_t compact(HandleRefVector& refs, std::size_t budget) override;
+
+        void reserve(std::size_t n);
+
+        /** \brief Returns the number of blocks of the hot array. */
+        std::size_t blockCount() const { return mHot.blockCount(); }
+        std::size_t capacity() const { return mHot.capacity(); }
+        std::size_t size() const { return mHot.size(); }
+        bool alive(ChunkedArrayHandle h) const { return mHot.alive(h); }
+
+        void setReusePolicy(ReusePolicy policy);
+        ReusePolicy getReusePolicy() const { return mHot.getReusePolicy(); }
+
+        /** \brief Takes the blocks of both arrays from the given resource, see ChunkedArray::setBlockResource. */
+        void setBlockResource(MemoryResource* resource);
+
+        /** \brief Calls f(reference) for every element in address order. */
+        template<typename F>
+        void forEach(F f);
+
+        /** \brief Calls f(HOT&) for every element, without touching the cold parts. */
+        template<typename F>
+        void forEachHot(F f) { mHot.forEach(f); }
+
+        /** \brief Calls f(COLD&) for every element, without touching the hot parts. */
+        template<typename F>
+        void forEachCold(F f) { mCold.forEach(f); }
+
+    private:
+        HotArray mHot;
+        ColdArray mCold;
+
+    public:
+        /** \brief Proxy to one element. Copies of a proxy refer to the same element. */
+        template<bool CONST>
+        class BasicReference
+        {
+        friend class SplitChunkedArray<HOT, COLD, BLOCK_SIZE, REUSE_C>;
+        template<bool> friend class BasicReference;
+        public:
+            /** \brief A const proxy can be made from a mutable one. */
+            BasicReference(const BasicReference<false>& other) : mHot(other.mHot), mCold(other.mCold), mHandle(other.mHandle) {}
+
+            typename std::conditional<CONST, const HOT&, HOT&>::type hot() const { return mHot->get(mHandle); }
+            typename std::conditional<CONST, const COLD&, COLD&>::type cold() const { return mCold->get(mHandle); }
+
+            /** \brief Copies both parts into a SplitComponent. */
+            operator SplitComponent<HOT, COLD>() const { return SplitComponent<HOT, COLD>{ hot(), cold() }; }
+
+        private:
+            HotArray* mHot;
+            ColdArray* mCold;
+            ChunkedArrayHandle mHandle;
+
+            BasicReference(const HotArray* hotArray, const ColdArray* coldArray, ChunkedArrayHandle h)
+                : mHot(const_cast<HotArray*>(hotArray)), mCold(const_cast<ColdArray*>(coldArray)), mHandle(h) {}
+        };
+    };
+
+    /**
+    * \brief Stores its elements in one dense array, without holes: destroy moves the last element into
+    * the freed place (swap-remove). A handle names a slot, and a slot table maps each slot to the
+    * current place of its element. The two arrays form a sparse set over the slots.
+    * Compared to a ChunkedArray, forEach and data() stream a single gap-free array, and a pool with
+    * heavy churn never fragments, so compact has nothing to do. In exchange get loads the slot table
+    * first, and adding may reallocate the dense array. References to elements stay valid only until
+    * the next add or destroy.
+    * T must be move constructible. Freed slots are reused most recent first, so the slot table stays
+    * as large as the highest number of elements alive at once.
+    * The dense array is taken from the block resource (see setBlockResource), the slot table from the
+    * MemoryResource given on construction.
+    */
+    template<typename T>
+    class PackedArray final : public BaseChunkedArray
+    {
+    public:
+        using reference = T&;
+        using const_reference = const T&;
+
+        /** \brief Constructs an empty array, nothing is allocated before the first add. */
+        explicit PackedArray(MemoryResource* resource = defaultResource());
+        ~PackedArray();
+
+        PackedArray(const PackedArray&) = delete;
+        PackedArray& operator=(const PackedArray&) = delete;
+
+        /** \brief Constructs an element from param at the end of the dense array and returns its handle. */
+        template<typename ...PARAM>
+        ChunkedArrayHandle add(PARAM&&... param);
+
+        /** \brief Adds n elements constructed from param, see ChunkedArray::addN. The handles are grouped
+        * into runs of neighbouring slots. */
+        template<typename ...PARAM>
+        ChunkedArrayRangeVector addN(std::size_t n, const PARAM&... param);
+
+        T& get(ChunkedArrayHandle h) { return mValues[mSlots[slotOf(h)]]; }
+        const T& get(ChunkedArrayHandle h) const { return mValues[mSlots[slotOf(h)]]; }
+
+        /** \brief Starts loading the element at h into the cache. Reads the slot table to find it. */
+        void prefetch(ChunkedArrayHandle h) const { dom::prefetch(mValues + mSlots[slotOf(h)]); }
+
+        /** \brief Destroys the element at h and moves the last element into its place. */
+        virtual void destroy(ChunkedArrayHandle h) override;
+        void destroyMany(const ChunkedArrayHandle* handles, std::size_t count);
+
+        /** \brief Destroys all elements. The memory is kept. */
+        virtual void clear() override;
+
+        /** \brief Releases the dense array if it is empty. Returns the number of released arrays (0 or 1). */
+        virtual std::size_t trim() override;
+
+        /** \brief Does nothing, the array is always dense. Returns 0. */
+        virtual std::size_t compact(HandleRefVector& refs, std::size_t budget) override;
+
+        /** \brief Grows the dense array to hold n elements without reallocation. */
+        void reserve(std::size_t n);
+
+        /** \brief Returns the number of dense arrays, 0 or 1. */
+        std::size_t blockCount() const { return mCapacity > 0 ? 1 : 0; }
+        std::size_t capacity() const { return mCapacity; }
+        std::size_t size() const { return mSize; }
+        bool alive(ChunkedArrayHandle h) const { return slotOf(h) < mSlots.size() && mSlots[slotOf(h)] != DEAD_SLOT; }
+
+        /** \brief Has no effect, a PackedArray has no holes to choose from. */
+        void setReusePolicy(ReusePolicy) {}
+        ReusePolicy getReusePolicy() const { return ReusePolicy::FREE_ORDER; }
+
+        /** \brief Takes the dense array from the given resource. The array must be empty. */
+        void setBlockResource(MemoryResource* resource);
+
+        /** \brief Calls f(T&) for every element, in the order of the dense array. */
+        template<typename F>
+        void forEach(F f);
+
+        /** \brief Returns the dense array, size() elements long. */
+        T* data() { return mValues; }
+        const T* data() const { return mValues; }
+
+    private:
+        static constexpr std::uint32_t DEAD_SLOT = std::numeric_limits<std::uint32_t>::max();
+
+        static std::size_t slotOf(ChunkedArrayHandle h) { return (std::size_t(h.block) << 16) | h.index; }
+
+        /** \brief Takes a free slot, or appends one, and points it to the end of the dense array.
+        * Does not allocate after reserveSlots for enough slots, so it can not throw then. */
+        std::uint32_t newSlot();
+
+        /** \brief Grows the slot bookkeeping so the next n calls of newSlot do not allocate. */
+        void reserveSlots(std::size_t n);
+
+        /** \brief Constructs n elements from param at values, destroys the constructed ones if one throws. */
+        template<typename ...PARAM>
+        static void constructN(T* values, std::size_t n, const PARAM&... param);
+
+        /** \brief Moves the dense array into a new allocation for capacity elements. */
+        void reallocate(std::size_t capacity);
+
+        /** \brief Like reallocate, but calls construct(values) on the new allocation before the old
+        * elements are moved, so the new elements may be built from references into the old array.
+        * If construct throws, the array stays as it was. */
+        template<typename F>
+        void reallocate(std::size_t capacity, F construct);
+
+        MemoryResource* mBlockResource;
+        T* mValues;
+        std::size_t mSize;
+        std::size_t mCapacity;
+        std::vector< std::uint32_t, ResourceAllocator<std::uint32_t> > mSlots; ///<place in mValues for each slot, DEAD_SLOT if free
+        std::vector< std::uint32_t, ResourceAllocator<std::uint32_t> > mOwners; ///<slot of each element of mValues
+        std::vector< std::uint32_t, ResourceAllocator<std::uint32_t> > mFreeSlots;
+    };
+
+    /**
+    * \brief A base class for all component base structs.
+    * CINDEX is a index type for components, rather small. COMP_TOTAL is the total number of components allowed.
+    */
+    template<typename CINDEX = unsigned short, CINDEX COMP_TOTAL = DEFAULT_COMPONENT_COUNT>
+    struct ComponentTraitsBase
+    {
+    protected:
+        /** \brief Returns a new, unique ID for a component-type, but doesnt give
+        * more than COMP_TOTAL different IDs. */
+        static CINDEX newID();
+    };
+
+    /**
+    * \brief A traits class for a specific component type C.
+    * Provides a unique ID for that type.
+    * Throws an exception, if a new ID is requested, when there are already
+    * COMP_TOTAL different component-types registered.
+    */
+    template<typename C, typename CINDEX = unsigned short, CINDEX COMP_TOTAL = DEFAULT_COMPONENT_COUNT>
+    struct ComponentTraits : public ComponentTraitsBase<CINDEX, COMP_TOTAL>
+    {
+    public:
+        static CINDEX getID();
+    };
+
+    /**
+    * \brief Default storage settings of a component type, see ComponentConfig.
+    * ALIGNMENT ... alignment of each component in its pool, at least alignof(C)
+    * BLOCK_SIZE ... number of components in one block of the pool; small values for rare or big
+    * components, large values for components with many instances
+    * REUSE_C ... minimum number of free slots before one is reused, see ChunkedArray
+    * MAX_BLOCKS ... if > 0, the pool reserves address space for that many blocks up front and
+    * addresses components without the block table, see ChunkedArray
+    * Layout ... AoSLayout, a SoALayout to store the component field by field in a SoAChunkedArray,
+    * or PackedLayout for a PackedArray, which suits components with heavy churn or few instances
+    * (ALIGNMENT and MAX_BLOCKS do not apply then, neither do they for a SplitComponent; a PackedArray
+    * also ignores BLOCK_SIZE and REUSE_C)
+    */
+    template<typename C>
+    struct DefaultComponentConfig
+    {
+        static constexpr std::size_t ALIGNMENT = alignof(C);
+        static constexpr std::size_t BLOCK_SIZE = DEFAULT_BLOCK_SIZE;
+        static constexpr std::size_t REUSE_C = 0;
+        static constexpr std::size_t MAX_BLOCKS = 0;
+        using Layout = AoSLayout;
+    };
+
+    /**
+    * \brief Specialization point for the storage settings of a component type. Derive the
+    * specialization from DefaultComponentConfig and override what should differ, e.g.
+    * template<> struct dom::ComponentConfig<Position> : dom::DefaultComponentConfig<Position>
+    * { static constexpr std::size_t ALIGNMENT = 64; };
+    * gives every Position its own cache line and aligns it for wide vector loads.
+    */
+    template<typename C>
+    struct ComponentConfig : public DefaultComponentConfig<C> {};
+
+    /** \brief Picks the pool type of component C from its ComponentConfig, see ComponentStorage. */
+    template<typename C, typename LAYOUT = typename ComponentConfig<C>::Layout>
+    struct ComponentStorageSelector
+    {
+        using type = SoAChunkedArray<C, LAYOUT, ComponentConfig<C>::BLOCK_SIZE, ComponentConfig<C>::REUSE_C>;
+    };
+
+    template<typename C>
+    struct ComponentStorageSelector<C, AoSLayout>
+    {
+        using type = ChunkedArray<C, ComponentConfig<C>::BLOCK_SIZE, ComponentConfig<C>::REUSE_C, ComponentConfig<C>::ALIGNMENT, ComponentConfig<C>::MAX_BLOCKS>;
+    };
+
+    template<typename C>
+    struct ComponentStorageSelector<C, PackedLayout>
+    {
+        using type = PackedArray<C>;
+    };
+
+    template<typename HOT, typename COLD>
+    struct ComponentStorageSelector<SplitComponent<HOT, COLD>, AoSLayout>
+    {
+        using C = SplitComponent<HOT, COLD>;
+        using type = SplitChunkedArray<HOT, COLD, ComponentConfig<C>::BLOCK_SIZE, ComponentConfig<C>::REUSE_C>;
+    };
+
+    /**
+    * \brief The pool that stores the components of type C, as configured by ComponentConfig<C>:
+    * a ChunkedArray, a SoAChunkedArray for components with a SoALayout, a PackedArray for the
+    * PackedLayout or a SplitChunkedArray for a SplitComponent. Its reference and const_reference types are what get and modify return: plain
+    * references, or proxies for the latter two.
+    */
+    template<typename C>
+    using ComponentStorage = typename ComponentStorageSelector<C>::type;
+
+    /**
+    * \brief An error thrown by ComponentTraitsBase, if there are more then
+    * COMP_TOTAL ids requested.
+    */
+    struct ComponentCountError : public std::runtime_error
+    {
+        ComponentCountError();
+    };
+
+
+
+    using EntityArrayHandle = ChunkedArrayHandle;
+    using ComponentHandle = ChunkedArrayHandle;
+    using ComponentHandleVector = std::vector< ComponentHandle, ResourceAllocator<ComponentHandle> >;
+
+    /**
+    * \brief The component handles of one entity, a vector with inline storage. Up to INLINE_CAPACITY
+    * handles live inside the entity record itself, so creating a typical entity allocates nothing and a
+    * component lookup reads the handle from the cache line of the record. Only entities with more
+    * components take a buffer from the MemoryResource. Not bigger than the std::vector it replaces.
+    */
+    class ComponentHandleList
+    {
+    public:
+        static constexpr std::size_t INLINE_CAPACITY = 4;
+
+        using iterator = ComponentHandle*;
+        using const_iterator = const ComponentHandle*;
+
+        explicit ComponentHandleList(MemoryResource* resource) : mResource(resource), mSize(0), mCapacity(INLINE_CAPACITY) {}
+
+        /** \brief Takes over the handles of other, which is left empty. */
+        ComponentHandleList(ComponentHandleList&& other);
+
+        ComponentHandleList(const ComponentHandleList&) = delete;
+        ComponentHandleList& operator=(const ComponentHandleList&) = delete;
+
+        ComponentHandle* data() { return mCapacity > INLINE_CAPACITY ? mHeap : reinterpret_cast<ComponentHandle*>(mInline); }
+        const ComponentHandle* data() const { return mCapacity > INLINE_CAPACITY ? mHeap : reinterpret_cast<const ComponentHandle*>(mInline); }
+
+        std::size_t size() const { return mSize; }
+        bool empty() const { return mSize == 0; }
+
+        ComponentHandle& operator[](std::size_t i) { return data()[i]; }
+        const ComponentHandle& operator[](std::size_t i) const { return data()[i]; }
+
+        iterator begin() { return data(); }
+        iterator end() { return data() + mSize; }
+        const_iterator begin() const { return data(); }
+        const_iterator end() const { return data() + mSize; }
+
+        /** \brief Makes room for n handles. Does nothing for n <= INLINE_CAPACITY. */
+        void reserve(std::size_t n);
+
+        void push_back(ComponentHandle h);
+
+        /** \brief Inserts h in front of pos and returns an iterator to it. */
+        iterator emplace(const_iterator pos, ComponentHandle h);
+
+        iterator erase(const_iterator pos);
+
+        void clear() { mSize = 0; }
+
+        ~ComponentHandleList();
+
+    private:
+        MemoryResource* mResource;
+        union
+        {
+            alignas(ComponentHandle) unsigned char mInline[INLINE_CAPACITY*sizeof(ComponentHandle)];
+            ComponentHandle* mHeap; ///<used once mCapacity > INLINE_CAPACITY
+        };
+        std::uint32_t mSize;
+        std::uint32_t mCapacity;
+    };
+
+    template<typename CINDEX, CINDEX COMP_TOTAL> class EntityData;
+    template<typename CINDEX, CINDEX COMP_TOTAL> class Universe;
+    template<typename C> class ComponentInstantiator;
+
+
+    /**
+    * \brief A helper class for components that can be attached multiple times to an entity.
+    * The component set is implemented as a vector and the components can be accessed by index.
+    * Note that MultiComponent-sets must not persist continously in memory,
+    * but the chances are good that they are.
+    */
+    template<typename C, typename CINDEX = unsigned short, CINDEX COMP_TOTAL = DEFAULT_COMPONENT_COUNT>
+    class MultiComponent
+    {
+    private:
+        ComponentHandleVector mHandles; ///<taken from the resource of the universe
+        Universe<CINDEX, COMP_TOTAL>* mUniverse; //the universe that holds this component, needed for correct destruction
+
+    public:
+        template<typename ... PARAM>
+        MultiComponent(std::size_t num, Universe<CINDEX, COMP_TOTAL>& universe, PARAM&& ... param);
+
+        MultiComponent();
+
+        /** \brief Creates copies of all components of the other set. */
+        MultiComponent(const MultiComponent& other);
+
+        /** \brief Takes over the components of the other set, which is left empty. */
+        MultiComponent(MultiComponent&& other);
+
+        MultiComponent& operator=(MultiComponent other);
+
+        template<typename ... PARAM>
+        void init(std::size_t num, Universe<CINDEX, COMP_TOTAL>& universe, PARAM&& ... param);
+
+        typename ComponentStorage<C>::reference getComponent(std::size_t index);
+        typename ComponentStorage<C>::const_reference getComponent(std::size_t index) const;
+        std::size_t getComponentCount() const;
 
         void cleanup();
 
@@ -306,14 +1557,14 @@ namespace dom
         * Throws an "No-Component-Found"-error if has<C>() is false when this method is called. O(1).
         */
         template<typename C>
-        const C& get() const;
+        typename ComponentStorage<C>::const_reference get() const;
 
         /**
         * \brief Gets a const reference to the requested component. Assumes that the component exists.
         * Throws an "No-Component-Found"-error if has<C>() is false when this method is called. O(1).
         */
         template<typename C>
-        C& modify() const;
+        typename ComponentStorage<C>::reference modify() const;
 
         /**
         * \brief Removes the component of type C from the entity. If the component doesnt exists, the method does nothing.
@@ -360,10 +1611,114 @@ namespace dom
     };
 
     /**
-    * \brief A struct that holds meta information for several entities.
+    * \brief The set of component types of an entity, one bit per component id. Works like a
+    * std::bitset<BITS>, but exposes its 64 bit words, so it can be hashed and compared a word at
+    * a time for any number of component types.
+    */
+    template<std::size_t BITS>
+    class Signature
+    {
+    public:
+        static constexpr std::size_t WORD_BITS = 64;
+        static constexpr std::size_t WORDS = (BITS + WORD_BITS - 1) / WORD_BITS;
+
+        Signature() : mWords() {}
+
+        bool test(std::size_t i) const { return (mWords[i / WORD_BITS] >> (i % WORD_BITS)) & 1u; }
+        Signature& set(std::size_t i) { mWords[i / WORD_BITS] |= uint64_t(1) << (i % WORD_BITS); return *this; }
+        Signature& set(std::size_t i, bool value) { return value ? set(i) : reset(i); }
+        Signature& reset(std::size_t i) { mWords[i / WORD_BITS] &= ~(uint64_t(1) << (i % WORD_BITS)); return *this; }
+        Signature& flip(std::size_t i) { mWords[i / WORD_BITS] ^= uint64_t(1) << (i % WORD_BITS); return *this; }
+
+        /** \brief Returns the i-th word, bit j of it is component id i*WORD_BITS + j. */
+        uint64_t word(std::size_t i) const { return mWords[i]; }
+
+        /** \brief Returns true if every bit of other is set here as well. */
+        bool contains(const Signature& other) const;
+
+        /** \brief Returns the number of set bits below bit i, i.e. the position of i among the set bits. */
+        std::size_t rank(std::size_t i) const;
+
+        /** \brief Returns the number of set bits. */
+        std::size_t count() const;
+
+        /** \brief Calls f(i) for every set bit i in ascending order. Skips empty words and finds
+        * the bits of a word with countTrailingZeros, so the cost follows the number of set bits. */
+        template<typename F>
+        void forEachSet(F f) const;
+
+        Signature& operator|=(const Signature& other);
+
+        bool operator==(const Signature& other) const { return mWords == other.mWords; }
+        bool operator!=(const Signature& other) const { return !(*this == other); }
+
+        /** \brief Mixes all words into a hash value. A handful of instructions per word. */
+        std::size_t hash() const;
+
+    private:
+        std::array<uint64_t, WORDS> mWords;
+    };
+
+    /**
+    * \brief A hash map from Signature to VALUE with open addressing: the entries live in one array
+    * and a key is searched by probing the neighbouring entries, so a lookup touches one or two cache
+    * lines and never allocates. Each entry keeps the full hash and compares it before the key.
+    * Erase shifts the following entries back, so no tombstones pile up.
+    * All memory is taken from the MemoryResource given on construction.
+    */
+    template<std::size_t BITS, typename VALUE>
+    class SignatureMap
+    {
+    public:
+        explicit SignatureMap(MemoryResource* resource = defaultResource());
+        ~SignatureMap();
+
+        SignatureMap(const SignatureMap&) = delete;
+        SignatureMap& operator=(const SignatureMap&) = delete;
+
+        /** \brief Returns the value of key, or nullptr if the key is not in the map. */
+        VALUE* find(const Signature<BITS>& key);
+
+        /** \brief Adds key, which must not be in the map yet, and returns its value. */
+        VALUE* insert(const Signature<BITS>& key, VALUE value);
+
+        /** \brief Removes key and its value, if it is in the map. */
+        void erase(const Signature<BITS>& key);
+
+        void clear();
+        std::size_t size() const { return mSize; }
+
+    private:
+        struct Entry
+        {
+            std::size_t hash; ///<0 for an empty entry
+            Signature<BITS> key;
+            VALUE value;
+        };
+
+        /** \brief The hash of key, never 0. */
+        static std::size_t hashOf(const Signature<BITS>& key) { std::size_t h = key.hash(); return h != 0 ? h : 1; }
+
+        /** \brief Returns the entry of key or the empty entry where it would go. */
+        Entry* probe(const Signature<BITS>& key, std::size_t hash) const;
+
+        void rehash(std::size_t capacity);
+
+        MemoryResource* mResource;
+        Entry* mEntries;
+        std::size_t mCapacity; ///<power of two, at least twice the size
+        std::size_t mSize;
+    };
+
+    /**
+    * \brief A struct that holds meta information for several entities.
     * All entities with the same components assigned share the same metadata.
     * Delivers information that can tell for each component type i what index it
-    * has in the componentList of the entity.
+    * has in the componentList of the entity: the number of mask bits below i (see Signature::rank),
+    * so the record stays small and the index is computed from the same cache line as the mask test.
+    * Each metadata also remembers its neighbours in the graph of signatures: the metadata an entity
+    * moves to when a single component is added or removed. The edges are cached in both directions
+    * and dropped together with either end.
     */
     template<typename CINDEX = unsigned short, CINDEX COMP_TOTAL = DEFAULT_COMPONENT_COUNT>
     struct MetaData
@@ -371,11 +1726,18 @@ namespace dom
     friend class EntityData<CINDEX, COMP_TOTAL>;
     friend class Universe<CINDEX, COMP_TOTAL>;
     private:
-        std::bitset< COMP_TOTAL > mComponentMask;
-        std::array<CINDEX, COMP_TOTAL> mMetaData;
+        /** \brief Toggling component in the mask of this metadata gives the mask of target. */
+        struct Edge
+        {
+            CINDEX component;
+            MetaData* target;
+        };
+
+        Signature<COMP_TOTAL> mComponentMask;
         unsigned mSharedCount;
+        std::vector< Edge, ResourceAllocator<Edge> > mEdges; ///<"add" edges for components outside the mask, "remove" edges for those in it
 
-        MetaData(std::bitset< COMP_TOTAL > initialMask);
+        MetaData(Signature<COMP_TOTAL> initialMask, MemoryResource* resource);
     };
 
     /**
@@ -397,9 +1759,12 @@ namespace dom
     class EntityData
     {
     friend class Universe<CINDEX, COMP_TOTAL>;
+    public:
+        explicit EntityData(MemoryResource* resource) : mMetaData(nullptr), mComponentHandles(resource) {}
+
     private:
         MetaData<CINDEX, COMP_TOTAL>* mMetaData; ///<points to metadata that all entities with the same bitset share
-        std::vector< ComponentHandle > mComponentHandles; ///<stores indices of assigned component in their managers
+        ComponentHandleList mComponentHandles; ///<stores indices of assigned component in their managers
     };
 
 
@@ -410,6 +1775,9 @@ namespace dom
     * components given a type C and a ComponentHandle.
     * Metadata for entities is also stored semi-continous.
     *
+    * All memory of the universe (pools, entity records, metadata) is taken from the MemoryResource
+    * given on construction.
+    *
     * Template parameters:
     * CINDEX ... index type for components
     * COMP_TOTAL ... total number of components allowed in the application
@@ -422,10 +1790,17 @@ namespace dom
     template <class C> friend class ComponentInstantiator;
     public:
         static constexpr std::size_t ENTITY_BLOCK_SIZE = 8192; ///<number of entities in a single, continous memory block
-        static constexpr std::size_t COMPONENT_BLOCK_SIZE = 8192; ///<number of components in a single, continous memory block
+        static constexpr std::size_t COMPONENT_BLOCK_SIZE = DEFAULT_BLOCK_SIZE; ///<block size of components without an own ComponentConfig
         static constexpr std::size_t ENTITY_REUSE_C = 1024; ///<minimum stack size until an entity slot is reused
+        static constexpr std::size_t PREFETCH_DISTANCE = 8; ///<number of entities getMany and gatherMany prefetch ahead per step
 
-        Universe();
+        /** \brief The type of the pool that stores the components of type C, as configured by ComponentConfig<C>. */
+        template<typename C>
+        using ComponentPool = ComponentStorage<C>;
+
+        /** \brief Takes all memory from resource: pools, entity records, metadata and the temporary
+        * lists of compact, nothing goes to the global heap. */
+        explicit Universe(MemoryResource* resource = defaultResource());
 
     public:
         /** \brief Creates an empty entity with a new, unique id and returns a handle to it.*/
@@ -440,10 +1815,28 @@ namespace dom
 
         /** \brief Creates n entities with the given components. This is even faster then calling create<C...>()
         * n times and should be the typical way of construction n entities that share the same bitfield.
-        * The function f is called for each created entity. */
+        * The components are default constructed with one ChunkedArray::addN per pool, so they end up
+        * next to each other. The function f is called for each created entity. */
         template<typename ... C>
         void create(std::size_t n, std::function<void(EntityHandle<CINDEX, COMP_TOTAL> e)> f);
 
+        /**
+        * \brief Destroys all entities in [first, last) and their components, like calling destroy() on each.
+        * The entities are grouped by metadata, so the components per pool are counted once per signature,
+        * then bucketed by type and every pool destroys its share in one call.
+        * Invalid handles and duplicates are skipped.
+        */
+        template<typename ITERATOR>
+        void destroy(ITERATOR first, ITERATOR last);
+
+        /**
+        * \brief Destroys all entities and components, e.g. when a level is unloaded. Pools of trivially
+        * destructible components are reset block-wise without visiting a single component, the memory
+        * is kept for the next level (see trim). All entity handles become invalid.
+        * MultiComponent sets must not outlive this call outside of an entity.
+        */
+        void clear();
+
     private:
         /** \brief Checks if entityData belonging to the given handle is still valid. */
         bool valid( const EntityHandle<CINDEX, COMP_TOTAL>& e ) const;
@@ -485,18 +1878,18 @@ namespace dom
         * Throws an "No-Component-Found"-error if has<C>() is false when this method is called. O(1).
         */
         template<typename C>
-        const C& getComponent( const EntityHandle<CINDEX, COMP_TOTAL>& e ) const;
+        typename ComponentStorage<C>::const_reference getComponent( const EntityHandle<CINDEX, COMP_TOTAL>& e ) const;
         template<typename C>
-        const C& getComponent( ComponentHandle c ) const;
+        typename ComponentStorage<C>::const_reference getComponent( ComponentHandle c ) const;
 
         /**
         * \brief Gets a const reference to the requested component. Assumes that the component exists.
         * Throws an "No-Component-Found"-error if has<C>() is false when this method is called. O(1).
         */
         template<typename C>
-        C& modifyComponent( const EntityHandle<CINDEX, COMP_TOTAL>& e );
+        typename ComponentStorage<C>::reference modifyComponent( const EntityHandle<CINDEX, COMP_TOTAL>& e );
         template<typename C>
-        C& modifyComponent( ComponentHandle c );
+        typename ComponentStorage<C>::reference modifyComponent( ComponentHandle c );
 
         /**
         * \brief Removes the component of type C from the entity. If the component doesnt exists, the method does nothing.
@@ -508,11 +1901,21 @@ namespace dom
         EntityID getID( const EntityHandle<CINDEX, COMP_TOTAL>& e );
 
         /** \brief After calling this method for an entity, its ensured that the internal
-        * datastructes are capable of the (new) entity. */
+        * datastructes are capable of the (new) entity and all entities with lower ids. */
         void accommodateEntity( const EntityArrayHandle& e );
 
         /** \brief Called when connected to an EntityData. */
-        void connect(EntityData<CINDEX, COMP_TOTAL>& data, std::bitset<COMP_TOTAL> mask);
+        void connect(EntityData<CINDEX, COMP_TOTAL>& data, Signature<COMP_TOTAL> mask);
+        void connect(EntityData<CINDEX, COMP_TOTAL>& data, MetaData<CINDEX, COMP_TOTAL>* meta);
+
+        /** \brief Returns the metadata of the given mask and creates it, if it doesnt exist yet. */
+        MetaData<CINDEX, COMP_TOTAL>* findMetaData(Signature<COMP_TOTAL> mask);
+
+        /**
+        * \brief Returns the metadata whose mask differs from the one of meta only in component id.
+        * Follows the cached edge of meta, or looks the metadata up and caches the edge in both directions.
+        */
+        MetaData<CINDEX, COMP_TOTAL>* transition(MetaData<CINDEX, COMP_TOTAL>& meta, CINDEX id);
 
         /** \brief Called when disconnected from an EntityData. */
         void disconnect(const EntityData<CINDEX, COMP_TOTAL>& data);
@@ -525,22 +1928,328 @@ namespace dom
         /** \brief Size method mostly useful for debugging. May useful for something else. */
         std::size_t getEntityCount() const;
 
+        /**
+        * \brief Allocates the entity blocks and generation counters for entities entities in total up front,
+        * e.g. while a level loads, so spawning them later does not allocate on these paths.
+        */
+        void reserve(std::size_t entities);
+
+        /** \brief Allocates the blocks for n components of type C in total up front. */
+        template<typename C>
+        void reserve(std::size_t n);
+
         /** \brief Size method mostly useful for debugging. May useful for something else. */
         template<typename C>
         std::size_t getComponentCount() const;
 
+        /**
+        * \brief Calls f(C&) for every component of type C in memory order. This streams the component
+        * pool linearly instead of going through entity handles. Components held by MultiComponent sets
+        * are visited too. f must not add or remove components of type C.
+        * For components with a SoALayout and for a SplitComponent f gets a proxy instead.
+        */
+        template<typename C, typename F>
+        void forEach(F f);
+
+        /**
+        * \brief Calls f(const BlockView&) for every block of the pool of C, which must have a SoALayout.
+        * The view hands out whole field arrays, so a kernel can process the x values of many
+        * components per vector instruction. See SoAChunkedArray::forEachBlock.
+        */
+        template<typename C, typename F>
+        void forEachBlock(F f);
+
+        /**
+        * \brief Calls f(C::Hot&) for the hot part of every component of type C, which must be a
+        * SplitComponent. Only the hot pool is streamed, the cold parts stay out of the cache.
+        */
+        template<typename C, typename F>
+        void forEachHot(F f);
+
+        /**
+        * \brief Writes a pointer to the component C of each of the count entities to out, like calling
+        * modify<C>() on each. The lookup runs as a pipeline: while entity i is resolved, the entity
+        * records, component handles and components of the next entities are already prefetched, so
+        * following many entity references waits for memory once instead of four times per entity.
+        * All entities must be valid and have a component of type C.
+        */
+        template<typename C>
+        void getMany(const EntityHandle<CINDEX, COMP_TOTAL>* entities, std::size_t count, C** out);
+
+        /** \brief Like getMany, but copies the components to out[0], ..., out[count-1]. */
+        template<typename C>
+        void gatherMany(const EntityHandle<CINDEX, COMP_TOTAL>* entities, std::size_t count, C* out) const;
+
+        /**
+        * \brief Selects the order in which the pool of component type C reuses free slots.
+        * ReusePolicy::LOWEST_BLOCK and ReusePolicy::FULLEST_BLOCK keep the pool dense after churn.
+        */
+        template<typename C>
+        void setReusePolicy(ReusePolicy policy);
+
+        /**
+        * \brief Takes the blocks of the pool of component type C from the given resource, for example
+        * a MappedBlockResource with huge pages. No component of type C may exist when this is called.
+        */
+        template<typename C>
+        void setBlockResource(MemoryResource* resource);
+
+        /**
+        * \brief Moves components of type C into the holes left by destroyed ones and patches the
+        * handles of the owning entities. Emptied blocks at the end of the pool are released.
+        * At most budget components are moved, so the work can be spread over several frames.
+        * Components that are not directly owned by an entity (e.g. the elements of a MultiComponent)
+        * are not moved. Returns the number of moved components, a result smaller than budget means
+        * the pool is as dense as it gets.
+        */
+        template<typename C>
+        std::size_t compact(std::size_t budget = std::numeric_limits<std::size_t>::max());
+
+        /** \brief Like compact<C>, but for all component pools. The budget is shared by all pools. */
+        std::size_t compactAll(std::size_t budget = std::numeric_limits<std::size_t>::max());
+
+        /** \brief Size method mostly useful for debugging. Returns the number of blocks the pool of C occupies. */
+        template<typename C>
+        std::size_t getComponentBlockCount() const;
+
+        /**
+        * \brief Returns the memory of all blocks that hold no entities or components anymore.
+        * Call it after despawning a large number of entities, so the memory usage follows the live
+        * entity count again. Returns the number of released blocks.
+        */
+        std::size_t trim();
+
+    private:
+        /** \brief Returns the pool of component type C and creates it, if it doesnt exist yet. */
+        template<typename C>
+        ComponentPool<C>& getManager();
+
+        /** \brief Destroys count components of a pool, see mDestroyFunctions. */
+        using DestroyFunction = void (*)(BaseChunkedArray& pool, const ComponentHandle* handles, std::size_t count);
+
+        template<typename C>
+        static void destroyComponents(BaseChunkedArray& pool, const ComponentHandle* handles, std::size_t count);
+
+        /** \brief Calls f(i, component) for the component C of each entity, prefetching ahead, see getMany. */
+        template<typename C, typename F>
+        void lookupMany(const EntityHandle<CINDEX, COMP_TOTAL>* entities, std::size_t count, F f) const;
+
     private:
-        std::array< std::unique_ptr<BaseChunkedArray>, COMP_TOTAL> mManagers;
+        using MetaDataMap = SignatureMap< COMP_TOTAL, ResourcePtr<MetaData<CINDEX, COMP_TOTAL>> >;
+
+        MemoryResource* mResource;
+        std::array< std::unique_ptr<BaseChunkedArray, PoolDeleter>, COMP_TOTAL> mManagers;
+        std::array< DestroyFunction, COMP_TOTAL > mDestroyFunctions; ///<filled together with mManagers, knows the type of each pool
+        std::bitset< COMP_TOTAL > mTrivialPools; ///<pools whose components need no destructor call
         ChunkedArray<EntityData<CINDEX, COMP_TOTAL>, ENTITY_BLOCK_SIZE, ENTITY_REUSE_C> mEntityData;
-        std::vector<SubID> mGenerations; ///<generation counter for each entity id (mapping is COMPONENT_BLOCK_SIZE*block + index)
-        std::unordered_map< unsigned long, std::unique_ptr<MetaData<CINDEX, COMP_TOTAL>> > mComponentMetadata; ///<maps bitset to Metadata
+        std::vector< SubID, ResourceAllocator<SubID> > mGenerations; ///<generation counter for each entity id (mapping is COMPONENT_BLOCK_SIZE*block + index)
+        MetaDataMap mComponentMetadata; ///<maps the component mask to its Metadata
         MetaData<CINDEX, COMP_TOTAL> mEmptyMeta;
 
+        /** \brief Walks through the component ranges of one type while a batch of entities is created. */
+        struct BatchCursor
+        {
+            std::size_t range;
+            std::size_t offset;
+            CINDEX position;
+        };
+
         template <typename... C>
         struct ComponentUnpacker;
     };
 
 
+    /** \brief Handle to an entity of an ArchetypeUniverse. The generation invalidates it when the entity is destroyed. */
+    struct ArchetypeEntity
+    {
+        std::uint32_t index;
+        SubID generation;
+
+        bool operator==(const ArchetypeEntity& other) const { return index == other.index && generation == other.generation; }
+        bool operator!=(const ArchetypeEntity& other) const { return !(*this == other); }
+    };
+
+    /**
+    * \brief An alternative storage engine to Universe, that stores all entities with the same
+    * component mask together. Each such signature (what a MetaData describes in Universe) has an
+    * archetype, which keeps its entities in chunks of about CHUNK_BYTES bytes with one column per
+    * component. The rows of an archetype are always dense.
+    *
+    * forEach<C...> only visits the archetypes whose mask contains all C and streams their columns
+    * linearly, there is no handle lookup per component. In exchange, adding or removing a component
+    * moves all components of the entity to another archetype. Destroying an entity moves the last
+    * entity of its archetype into the hole. So references to components stay valid only until the next
+    * create, destroy, add or remove in the same archetypes.
+    *
+    * Components must be move constructible. All memory is taken from the MemoryResource given on construction.
+    *
+    * Template parameters:
+    * CINDEX ... index type for components
+    * COMP_TOTAL ... total number of components allowed in the application
+    */
+    template<typename CINDEX = unsigned short, CINDEX COMP_TOTAL = 256>
+    class ArchetypeUniverse
+    {
+    public:
+        static constexpr std::size_t CHUNK_BYTES = 16384; ///<size of a chunk, fewer rows fit if the components are big
+
+        explicit ArchetypeUniverse(MemoryResource* resource = defaultResource());
+        ~ArchetypeUniverse();
+
+        ArchetypeUniverse(const ArchetypeUniverse&) = delete;
+        ArchetypeUniverse& operator=(const ArchetypeUniverse&) = delete;
+
+        /** \brief Creates an entity without components. */
+        ArchetypeEntity create();
+
+        /** \brief Creates an entity with default constructed components of the given types. */
+        template<typename ... C>
+        ArchetypeEntity create();
+
+        /** \brief Creates an entity and moves the given components into its row. */
+        template<typename ... C>
+        ArchetypeEntity create(C... components);
+
+        /** \brief Destroys the entity and its components. Does nothing for invalid handles. */
+        void destroy(ArchetypeEntity e);
+
+        /** \brief Destroys all entities. The archetypes are kept, their chunks are released. */
+        void clear();
+
+        /** \brief Returns true if e refers to an entity that was not destroyed. */
+        bool valid(ArchetypeEntity e) const;
+
+        /** \brief Returns true if the entity has a component of type C. O(1), a single bit check. */
+        template<typename C>
+        bool has(ArchetypeEntity e) const;
+
+        /** \brief Returns the component C of the entity, which must have one. O(1). */
+        template<typename C>
+        C& get(ArchetypeEntity e);
+        template<typename C>
+        const C& get(ArchetypeEntity e) const;
+
+        /**
+        * \brief Moves the entity to the archetype with C added and constructs C from param there.
+        * If the entity already has a C, that one is returned unchanged. O(k), where k is the number of
+        * components of the entity.
+        */
+        template<typename C, typename ... PARAM>
+        C& add(ArchetypeEntity e, PARAM&&... param);
+
+        /** \brief Moves the entity to the archetype without C. Does nothing if the entity has no C. O(k). */
+        template<typename C>
+        void remove(ArchetypeEntity e);
+
+        /**
+        * \brief Calls f(C&...) for every entity that has all components C. Only matching archetypes
+        * are visited and their columns are streamed chunk by chunk. f must not change the structure
+        * of the universe (create, destroy, add, remove).
+        */
+        template<typename ... C, typename F>
+        void forEach(F f);
+
+        /**
+        * \brief Calls f(count, C*...) for every chunk that holds entities with all components C. The
+        * pointers are the columns of the chunk, so a kernel can run over count elements of each.
+        */
+        template<typename ... C, typename F>
+        void forEachChunk(F f);
+
+        /** \brief Size method mostly useful for debugging. */
+        std::size_t getEntityCount() const;
+
+        /** \brief Size method mostly useful for debugging. Returns the number of different signatures seen so far. */
+        std::size_t getArchetypeCount() const;
+
+    private:
+        /** \brief Type-erased operations on one component type, filled when the type is first used. */
+        struct ColumnType
+        {
+            std::size_t size;
+            std::size_t alignment;
+            void (*relocate)(void* to, void* from); ///<move constructs at to and destroys from
+            void (*destroy)(void* p);
+        };
+
+        struct Chunk
+        {
+            unsigned char* data;
+            std::size_t count;
+        };
+
+        /** \brief All entities of one signature. Every chunk but the last is full. */
+        struct Archetype
+        {
+            Archetype(Signature<COMP_TOTAL> cMask, MemoryResource* resource)
+                : mask(cMask), components(resource), offsets(resource), chunks(resource), capacity(0), chunkBytes(0),
+                  chunkAlignment(CACHE_LINE_SIZE), size(0) {}
+
+            Signature<COMP_TOTAL> mask;
+            std::array<CINDEX, COMP_TOTAL> columns; ///<column of each component in mask
+            std::vector<CINDEX, ResourceAllocator<CINDEX>> components; ///<component id of each column
+            std::vector<std::size_t, ResourceAllocator<std::size_t>> offsets; ///<byte offset of each column in a chunk
+            std::vector<Chunk, ResourceAllocator<Chunk>> chunks;
+            std::size_t capacity; ///<rows per chunk
+            std::size_t chunkBytes;
+            std::size_t chunkAlignment; ///<a cache line, or more for over-aligned components
+            std::size_t size; ///<number of entities
+        };
+
+        /** \brief Where the components of an entity live. The entity index column at offset 0 of each chunk leads back here. */
+        struct EntityRecord
+        {
+            Archetype* archetype;
+            std::uint32_t chunk;
+            std::uint32_t row;
+        };
+
+        template<typename C>
+        static void relocateComponent(void* to, void* from);
+
+        template<typename C>
+        static void destroyComponent(void* p);
+
+        /** \brief Fills mTypes for C, if it is not known yet, and returns the id of C. */
+        template<typename C>
+        CINDEX registerType();
+
+        /** \brief Returns the archetype for the given mask and creates it, if it doesnt exist yet. */
+        Archetype& getArchetype(Signature<COMP_TOTAL> mask);
+
+        /** \brief Appends a row to the archetype and stores the entity index in it. The components are not constructed. */
+        EntityRecord allocateRow(Archetype& archetype, std::uint32_t entity);
+
+        /** \brief Fills the given row, whose components are already gone, with the last row of the archetype. */
+        void vacateRow(Archetype& archetype, std::uint32_t chunk, std::uint32_t row);
+
+        /** \brief Returns the address of a component in the given row. */
+        void* cell(const Archetype& archetype, std::uint32_t chunk, std::size_t column, std::uint32_t row) const;
+
+        /** \brief Returns the column of component C in the given chunk. */
+        template<typename C>
+        static C* column(const Archetype& archetype, const Chunk& chunk);
+
+        /** \brief Creates an entity in the archetype of C... and constructs its components from the arguments. */
+        template<typename ... C, typename ... ARG>
+        ArchetypeEntity createEntity(ARG&&... components);
+
+        template<typename F, typename ... C>
+        static void streamChunk(F& f, std::size_t count, C*... columns);
+
+    private:
+        using ArchetypeMap = SignatureMap<COMP_TOTAL, Archetype*>;
+
+        MemoryResource* mResource;
+        std::array<ColumnType, COMP_TOTAL> mTypes; ///<size 0 for types that were not used yet
+        std::vector< ResourcePtr<Archetype>, ResourceAllocator<ResourcePtr<Archetype>> > mArchetypes;
+        ArchetypeMap mArchetypeMap; ///<maps the mask to its archetype
+        std::vector< EntityRecord, ResourceAllocator<EntityRecord> > mRecords;
+        std::vector< SubID, ResourceAllocator<SubID> > mGenerations;
+        std::vector< std::uint32_t, ResourceAllocator<std::uint32_t> > mFreeEntities;
+    };
+
+
     //////////////////////////////////////////////////////////////////////////////////////////////////////////
     //////////////////////TEMPLATE_UNPACKING//////////////////////////////////////////////////////////////////
     //////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -549,24 +2258,25 @@ namespace dom
     template < typename C1, typename... C>
     struct Universe<CINDEX, COMP_TOTAL>::ComponentUnpacker<C1, C...>
     {
-        static void prepare(std::bitset< COMP_TOTAL >& mask)
+        static void prepare(Signature<COMP_TOTAL>& mask)
         {
             mask.set(ComponentTraits<C1, CINDEX, COMP_TOTAL>::getID());
             ComponentUnpacker<C...>::prepare(mask);
         }
 
         static void unpack(Universe<CINDEX, COMP_TOTAL>& universe,
-                           std::vector< ComponentHandle >& handles,
-                           std::bitset< COMP_TOTAL >& oldMask,
-                           std::array< CINDEX, COMP_TOTAL >& positions,
+                           ComponentHandleList& handles,
+                           Signature<COMP_TOTAL>& oldMask,
+                           const Signature<COMP_TOTAL>& newMask,
                            ComponentInstantiator<C1> c1,
                            ComponentInstantiator<C>... c)
         {
             if (!oldMask.test(ComponentTraits<C1, CINDEX, COMP_TOTAL>::getID())) //dont add if such a component was already assigned
             {
                 //store the handle at the correct position
-                if (positions[ComponentTraits<C1, CINDEX, COMP_TOTAL>::getID()] < handles.size())
-                    handles.emplace(handles.begin() + positions[ComponentTraits<C1, CINDEX, COMP_TOTAL>::getID()], c1.handle);
+                const std::size_t position = newMask.rank(ComponentTraits<C1, CINDEX, COMP_TOTAL>::getID());
+                if (position < handles.size())
+                    handles.emplace(handles.begin() + position, c1.handle);
                 else
                     handles.emplace(handles.end(), c1.handle);
             }
@@ -575,41 +2285,54 @@ namespace dom
                 c1.clear(universe);
             }
             //recursive...
-            ComponentUnpacker<C...>::unpack(universe, handles, oldMask, positions, c...);
+            ComponentUnpacker<C...>::unpack(universe, handles, oldMask, newMask, c...);
         }
 
-        static void unpack(std::vector< ComponentHandle >& handles,
-                           std::array< CINDEX, COMP_TOTAL >& positions,
+        static void unpack(ComponentHandleList& handles,
+                           const Signature<COMP_TOTAL>& newMask,
                            ComponentInstantiator<C1> c1,
                            ComponentInstantiator<C>... c)
         {
             //store the handle at the correct position
-            if (positions[ComponentTraits<C1, CINDEX, COMP_TOTAL>::getID()] < handles.size())
-                handles.emplace(handles.begin() + positions[ComponentTraits<C1, CINDEX, COMP_TOTAL>::getID()], c1.handle);
+            const std::size_t position = newMask.rank(ComponentTraits<C1, CINDEX, COMP_TOTAL>::getID());
+            if (position < handles.size())
+                handles.emplace(handles.begin() + position, c1.handle);
             else
                 handles.emplace(handles.end(), c1.handle);
             //recursive...
-            ComponentUnpacker<C...>::unpack(handles, positions, c...);
+            ComponentUnpacker<C...>::unpack(handles, newMask, c...);
         }
 
 
 
         static void checkedUnpack(Universe<CINDEX, COMP_TOTAL>& universe,
                                   const EntityHandle< CINDEX, COMP_TOTAL >& reffer,
-                                  std::vector< ComponentHandle >& handles,
-                                  std::array< CINDEX, COMP_TOTAL >& positions)
+                                  ComponentHandleList& handles,
+                                  const Signature<COMP_TOTAL>& newMask)
         {
             if (reffer.template has<C1>())
             {
                 auto c = ComponentInstantiator<C1>(universe, reffer.template get<C1>());
                 //store the handle at the correct position
-                if (positions[ComponentTraits<C1, CINDEX, COMP_TOTAL>::getID()] < handles.size())
-                    handles.emplace(handles.begin() + positions[ComponentTraits<C1, CINDEX, COMP_TOTAL>::getID()], c.handle);
+                const std::size_t position = newMask.rank(ComponentTraits<C1, CINDEX, COMP_TOTAL>::getID());
+                if (position < handles.size())
+                    handles.emplace(handles.begin() + position, c.handle);
                 else
                     handles.emplace(handles.end(), c.handle);
             }
             //recursive...
-            ComponentUnpacker<C...>::checkedUnpack(universe, reffer, handles, positions);
+            ComponentUnpacker<C...>::checkedUnpack(universe, reffer, handles, newMask);
+        }
+
+        static void addN(Universe<CINDEX, COMP_TOTAL>& universe,
+                         std::size_t n,
+                         const Signature<COMP_TOTAL>& newMask,
+                         ChunkedArrayRangeVector& ranges,
+                         BatchCursor* cursors)
+        {
+            ComponentUnpacker<C1>::addN(universe, n, newMask, ranges, cursors);
+            //recursive...
+            ComponentUnpacker<C...>::addN(universe, n, newMask, ranges, cursors + 1);
         }
     };
 
@@ -617,21 +2340,22 @@ namespace dom
     template <typename C1>
     struct Universe<CINDEX, COMP_TOTAL>::ComponentUnpacker<C1>
     {
-        static void prepare(std::bitset< COMP_TOTAL >& mask)
+        static void prepare(Signature<COMP_TOTAL>& mask)
         {
             mask.set(ComponentTraits<C1, CINDEX, COMP_TOTAL>::getID());
         }
 
         static void unpack(Universe<CINDEX, COMP_TOTAL>& universe,
-                           std::vector< ComponentHandle >& handles,
-                           std::bitset< COMP_TOTAL >& oldMask,
-                           std::array< CINDEX, COMP_TOTAL >& positions,
+                           ComponentHandleList& handles,
+                           Signature<COMP_TOTAL>& oldMask,
+                           const Signature<COMP_TOTAL>& newMask,
                            ComponentInstantiator<C1> c1)
         {
             if (!oldMask.test(ComponentTraits<C1, CINDEX, COMP_TOTAL>::getID())) //dont add if such a component is already assigned
             {
-                if (positions[ComponentTraits<C1, CINDEX, COMP_TOTAL>::getID()] < handles.size())
-                    handles.emplace(handles.begin() + positions[ComponentTraits<C1, CINDEX, COMP_TOTAL>::getID()], c1.handle);
+                const std::size_t position = newMask.rank(ComponentTraits<C1, CINDEX, COMP_TOTAL>::getID());
+                if (position < handles.size())
+                    handles.emplace(handles.begin() + position, c1.handle);
                 else
                     handles.emplace(handles.end(), c1.handle);
             }
@@ -641,27 +2365,43 @@ namespace dom
             }
         }
 
-        static void unpack(std::vector< ComponentHandle >& handles,
-                           std::array< CINDEX, COMP_TOTAL >& positions,
+        static void unpack(ComponentHandleList& handles,
+                           const Signature<COMP_TOTAL>& newMask,
                            ComponentInstantiator<C1> c1)
         {
-            if (positions[ComponentTraits<C1, CINDEX, COMP_TOTAL>::getID()] < handles.size())
-                handles.emplace(handles.begin() + positions[ComponentTraits<C1, CINDEX, COMP_TOTAL>::getID()], c1.handle);
+            const std::size_t position = newMask.rank(ComponentTraits<C1, CINDEX, COMP_TOTAL>::getID());
+            if (position < handles.size())
+                handles.emplace(handles.begin() + position, c1.handle);
             else
                 handles.emplace(handles.end(), c1.handle);
         }
 
+        /** \brief Creates n components C1 in one batch, appends their ranges and points the cursor to the first one. */
+        static void addN(Universe<CINDEX, COMP_TOTAL>& universe,
+                         std::size_t n,
+                         const Signature<COMP_TOTAL>& newMask,
+                         ChunkedArrayRangeVector& ranges,
+                         BatchCursor* cursors)
+        {
+            cursors->range = ranges.size();
+            cursors->offset = 0;
+            cursors->position = newMask.rank(ComponentTraits<C1, CINDEX, COMP_TOTAL>::getID());
+            ChunkedArrayRangeVector components = universe.template getManager<C1>().addN(n);
+            ranges.insert(ranges.end(), components.begin(), components.end());
+        }
+
         static void checkedUnpack(Universe<CINDEX, COMP_TOTAL>& universe,
                                   const EntityHandle< CINDEX, COMP_TOTAL >& reffer,
-                                  std::vector< ComponentHandle >& handles,
-                                  std::array< CINDEX, COMP_TOTAL >& positions)
+                                  ComponentHandleList& handles,
+                                  const Signature<COMP_TOTAL>& newMask)
         {
             if (reffer.template has<C1>())
             {
                 auto c = ComponentInstantiator<C1>(universe, reffer.template get<C1>());
                 //store the handle at the correct position
-                if (positions[ComponentTraits<C1, CINDEX, COMP_TOTAL>::getID()] < handles.size())
-                    handles.emplace(handles.begin() + positions[ComponentTraits<C1, CINDEX, COMP_TOTAL>::getID()], c.handle);
+                const std::size_t position = newMask.rank(ComponentTraits<C1, CINDEX, COMP_TOTAL>::getID());
+                if (position < handles.size())
+                    handles.emplace(handles.begin() + position, c.handle);
                 else
                     handles.emplace(handles.end(), c.handle);
             }
@@ -673,612 +2413,2966 @@ namespace dom
     //////////////////////IMPLEMENTATION//////////////////////////////////////////////////////////////////////
     //////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
-    ChunkedArray<T, BLOCK_SIZE, REUSE_C>::ChunkedArray()
+    inline void* NewDeleteResource::allocate(std::size_t bytes, std::size_t alignment)
     {
-        mBlocks.emplace_back();
-        mBlocks.back().ptr = alloc.allocate(BLOCK_SIZE);
+        if (alignment <= alignof(std::max_align_t))
+            return ::operator new(bytes);
+        //over-aligned: allocate more and remember the original pointer in front of the aligned one
+        void* raw = ::operator new(bytes + alignment + sizeof(void*));
+        std::uintptr_t aligned = (reinterpret_cast<std::uintptr_t>(raw) + sizeof(void*) + alignment - 1) & ~(std::uintptr_t(alignment) - 1);
+        reinterpret_cast<void**>(aligned)[-1] = raw;
+        return reinterpret_cast<void*>(aligned);
     }
 
-    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
-    template<typename ...PARAM>
-    ChunkedArrayHandle ChunkedArray<T, BLOCK_SIZE, REUSE_C>::add(PARAM&&... param)
+    inline void NewDeleteResource::deallocate(void* p, std::size_t, std::size_t alignment)
     {
-        ChunkedArrayHandle h;
-        if (mFreeSlots.size() > REUSE_C) //reuse a previously abadoned slot
-        {
-            h = mFreeSlots.front();
-            mFreeSlots.pop();
-        }
-        else if (mBlocks.back().contentCount >= BLOCK_SIZE) //need to create a new block
-        {
-            T* hint = mBlocks.back().ptr + BLOCK_SIZE;
-            mBlocks.emplace_back();
-            mBlocks.back().ptr = alloc.allocate(BLOCK_SIZE, hint); //allocate new memory possibly near the existing blocks
-            h.block = mBlocks.size() -1;
-            h.index = mBlocks.back().endIndex++;
-        }
+        if (alignment <= alignof(std::max_align_t))
+            ::operator delete(p);
         else
-        {
-            h.block = mBlocks.size() -1;
-            h.index = mBlocks.back().endIndex++;
-        }
-        ++(mBlocks[h.block].contentCount);
-        std::allocator_traits<std::allocator<T>>::construct(
-                          alloc,
-                          mBlocks[h.block].ptr + h.index,
-                          std::forward<PARAM>(param)... );  //construct component C in place
-        return h;
+            ::operator delete(static_cast<void**>(p)[-1]);
     }
 
-    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
-    T& ChunkedArray<T, BLOCK_SIZE, REUSE_C>::get(ChunkedArrayHandle h)
+    inline MemoryResource* defaultResource()
     {
-        return (mBlocks[h.block].ptr)[h.index];
+        static NewDeleteResource resource;
+        return &resource;
     }
 
-    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
-    const T& ChunkedArray<T, BLOCK_SIZE, REUSE_C>::get(ChunkedArrayHandle h) const
+
+
+    inline std::size_t VirtualRange::pageSize()
     {
-        return (mBlocks[h.block].ptr)[h.index];
+    #ifdef DOM_HAS_MMAP
+        static const std::size_t size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        return size;
+    #else
+        return 4096;
+    #endif
     }
 
-    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
-    void ChunkedArray<T, BLOCK_SIZE, REUSE_C>::destroy(ChunkedArrayHandle h)
+    inline void VirtualRange::reserve(std::size_t bytes, std::size_t alignment)
     {
-        mFreeSlots.push(h);
-        --(mBlocks[h.block].contentCount);
-        std::allocator_traits<std::allocator<T>>::destroy(  alloc,
-                                                        mBlocks[h.block].ptr + h.index);
+        //reserve alignment bytes more, so the usable range can start on an aligned address
+        mReservationSize = bytes + alignment;
+    #ifdef DOM_HAS_MMAP
+        void* p = mmap(nullptr, mReservationSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p == MAP_FAILED)
+            throw std::bad_alloc();
+    #else
+        void* p = ::operator new(mReservationSize);
+    #endif
+        mReservation = static_cast<char*>(p);
+        std::uintptr_t base = (reinterpret_cast<std::uintptr_t>(mReservation) + alignment - 1) & ~(std::uintptr_t(alignment) - 1);
+        mBase = reinterpret_cast<char*>(base);
+        mSize = bytes;
     }
 
-    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
-    std::size_t ChunkedArray<T, BLOCK_SIZE, REUSE_C>::blockCount() const
+    inline void VirtualRange::commit(char* p, std::size_t bytes, HugePages hugePages)
     {
-        return mBlocks.size();
+    #ifdef DOM_HAS_MMAP
+        bytes = (bytes + pageSize() - 1) / pageSize() * pageSize();
+    #ifdef MAP_HUGETLB
+        if (hugePages == HugePages::EXPLICIT &&
+            mmap(p, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1, 0) != MAP_FAILED)
+            return;
+    #endif
+        if (mmap(p, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED)
+            throw std::bad_alloc();
+    #ifdef MADV_HUGEPAGE
+        if (hugePages == HugePages::TRANSPARENT)
+            madvise(p, bytes, MADV_HUGEPAGE); //only advice, failure is fine
+    #endif
+    #endif
+        (void)p; (void)bytes; (void)hugePages;
     }
 
-    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
-    std::size_t ChunkedArray<T, BLOCK_SIZE, REUSE_C>::size() const
+    inline void VirtualRange::decommit(char* p, std::size_t bytes)
     {
-        std::size_t sum = 0;
-        for (const auto& block : mBlocks)
-            sum += block.contentCount;
-        return sum;
+    #ifdef DOM_HAS_MMAP
+        //mapping the range anew drops its pages and keeps the address space reserved
+        bytes = (bytes + pageSize() - 1) / pageSize() * pageSize();
+        mmap(p, bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+    #endif
+        (void)p; (void)bytes;
     }
 
-    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
-    ChunkedArray<T, BLOCK_SIZE, REUSE_C>::~ChunkedArray()
+    inline VirtualRange::~VirtualRange()
     {
-        for (const auto& block : mBlocks)
-        {
-            alloc.deallocate(block.ptr, BLOCK_SIZE);
-        }
+        if (!mReservation)
+            return;
+    #ifdef DOM_HAS_MMAP
+        munmap(mReservation, mReservationSize);
+    #else
+        ::operator delete(mReservation);
+    #endif
     }
 
+#ifdef DOM_HAS_MMAP
+    inline MappedBlockResource::MappedBlockResource(std::size_t reserveBytes, HugePages hugePages)
+        : mGranularity(hugePages == HugePages::EXPLICIT ? HUGE_PAGE_SIZE : VirtualRange::pageSize()),
+          mHugePages(hugePages)
+    {
+        mRange.reserve(roundUp(reserveBytes), HUGE_PAGE_SIZE);
+        mBase = mRange.base();
+        mEnd = mBase + mRange.size();
+        mTop = mBase;
+    }
 
+    inline void* MappedBlockResource::allocate(std::size_t bytes, std::size_t alignment)
+    {
+        const std::size_t size = roundUp(bytes);
+        for (std::size_t i = 0; i < mFreeRanges.size(); ++i)
+        {
+            if (mFreeRanges[i].second == size && reinterpret_cast<std::uintptr_t>(mFreeRanges[i].first) % alignment == 0)
+            {
+                char* p = mFreeRanges[i].first;
+                mFreeRanges[i] = mFreeRanges.back();
+                mFreeRanges.pop_back();
+                mRange.commit(p, size, mHugePages);
+                return p;
+            }
+        }
+        std::uintptr_t top = (reinterpret_cast<std::uintptr_t>(mTop) + alignment - 1) & ~(std::uintptr_t(alignment) - 1);
+        char* p = reinterpret_cast<char*>(top);
+        if (p + size > mEnd)
+            throw std::bad_alloc();
+        mRange.commit(p, size, mHugePages);
+        mTop = p + size;
+        return p;
+    }
 
-    template<typename CINDEX, CINDEX COMP_TOTAL>
-    CINDEX ComponentTraitsBase<CINDEX, COMP_TOTAL>::newID()
+    inline void MappedBlockResource::deallocate(void* ptr, std::size_t bytes, std::size_t)
     {
-        static CINDEX idCounter = 0;
-        if (idCounter < COMP_TOTAL)
+        char* p = static_cast<char*>(ptr);
+        const std::size_t size = roundUp(bytes);
+        mRange.decommit(p, size);
+        if (p + size == mTop) //the highest block, shrink the used range
         {
-            return idCounter++;
+            mTop = p;
+            bool lowered = true;
+            while (lowered) //free ranges that are now on top go as well
+            {
+                lowered = false;
+                for (std::size_t i = 0; i < mFreeRanges.size(); ++i)
+                {
+                    if (mFreeRanges[i].first + mFreeRanges[i].second == mTop)
+                    {
+                        mTop = mFreeRanges[i].first;
+                        mFreeRanges[i] = mFreeRanges.back();
+                        mFreeRanges.pop_back();
+                        lowered = true;
+                        break;
+                    }
+                }
+            }
         }
         else
         {
-            throw(ComponentCountError());
+            mFreeRanges.emplace_back(p, size);
         }
     }
 
-    template<typename C, typename CINDEX, CINDEX COMP_TOTAL>
-    CINDEX ComponentTraits<C, CINDEX, COMP_TOTAL>::getID()
+    inline MappedBlockResource::~MappedBlockResource() {}
+
+    inline void* NumaBlockResource::allocate(std::size_t bytes, std::size_t alignment)
     {
-        const static CINDEX id = ComponentTraitsBase<CINDEX, COMP_TOTAL>::newID();
-        return id;
+        if (!mapped(bytes, alignment))
+            return mUpstream->allocate(bytes, alignment);
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            throw std::bad_alloc();
+        mBound = false;
+    #ifdef DOM_HAS_NUMA
+        const std::size_t wordBits = sizeof(unsigned long)*8;
+        if (mNode >= 0 && static_cast<std::size_t>(mNode) < NODE_WORDS*wordBits)
+        {
+            unsigned long mask[NODE_WORDS] = {};
+            mask[mNode / wordBits] = 1ul << (mNode % wordBits);
+            //the kernel expects one bit more than the mask holds
+            mBound = syscall(SYS_mbind, p, bytes, mStrict ? MPOL_BIND_MODE : MPOL_PREFERRED_MODE,
+                             mask, NODE_WORDS*wordBits + 1, 0) == 0;
+        }
+    #endif
+        return p;
     }
 
-    inline ComponentCountError::ComponentCountError() :
-        std::runtime_error("Attempt to create more than the maximum number of components.") {}
-
-
+    inline void NumaBlockResource::deallocate(void* p, std::size_t bytes, std::size_t alignment)
+    {
+        if (!mapped(bytes, alignment))
+            mUpstream->deallocate(p, bytes, alignment);
+        else
+            munmap(p, bytes);
+    }
 
+    inline int NumaBlockResource::currentNode()
+    {
+    #if defined(DOM_HAS_NUMA) && defined(SYS_getcpu)
+        unsigned cpu = 0;
+        unsigned node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+            return static_cast<int>(node);
+    #endif
+        return -1;
+    }
+#endif
 
-    template<typename CINDEX, CINDEX COMP_TOTAL>
-    EntityHandle<CINDEX, COMP_TOTAL>::EntityHandle(Universe<CINDEX, COMP_TOTAL>* cUniverse,
-                                                   EntityArrayHandle cHandle,
-                                                   unsigned short cGeneration)
-        : mHandle(cHandle), mGeneration(cGeneration), mUniverse(cUniverse) {}
 
 
-    template<typename CINDEX, CINDEX COMP_TOTAL>
-    EntityHandle<CINDEX, COMP_TOTAL>::EntityHandle()
-        : mHandle(EntityArrayHandle::null()), mGeneration(0), mUniverse(nullptr) {}
+    inline ComponentHandleList::ComponentHandleList(ComponentHandleList&& other)
+        : mResource(other.mResource), mSize(other.mSize), mCapacity(other.mCapacity)
+    {
+        if (mCapacity > INLINE_CAPACITY)
+            mHeap = other.mHeap;
+        else
+            std::memcpy(mInline, other.mInline, sizeof(mInline));
+        other.mSize = 0;
+        other.mCapacity = INLINE_CAPACITY;
+    }
 
-    template<typename CINDEX, CINDEX COMP_TOTAL>
-    bool EntityHandle<CINDEX, COMP_TOTAL>::valid() const
+    inline void ComponentHandleList::reserve(std::size_t n)
     {
-        return mUniverse && mUniverse->valid(*this);
+        if (n <= mCapacity)
+            return;
+        ComponentHandle* buffer = static_cast<ComponentHandle*>( mResource->allocate(n*sizeof(ComponentHandle), alignof(ComponentHandle)) );
+        std::memcpy(buffer, data(), mSize*sizeof(ComponentHandle));
+        if (mCapacity > INLINE_CAPACITY)
+            mResource->deallocate(mHeap, mCapacity*sizeof(ComponentHandle), alignof(ComponentHandle));
+        mHeap = buffer;
+        mCapacity = static_cast<std::uint32_t>(n);
     }
 
+    inline void ComponentHandleList::push_back(ComponentHandle h)
+    {
+        if (mSize == mCapacity)
+            reserve(2*mCapacity);
+        data()[mSize++] = h;
+    }
+
+    inline ComponentHandleList::iterator ComponentHandleList::emplace(const_iterator pos, ComponentHandle h)
+    {
+        const std::size_t index = static_cast<std::size_t>(pos - data());
+        if (mSize == mCapacity)
+            reserve(2*mCapacity);
+        ComponentHandle* p = data() + index;
+        std::memmove(p + 1, p, (mSize - index)*sizeof(ComponentHandle));
+        *p = h;
+        ++mSize;
+        return p;
+    }
+
+    inline ComponentHandleList::iterator ComponentHandleList::erase(const_iterator pos)
+    {
+        ComponentHandle* p = data() + (pos - data());
+        std::memmove(p, p + 1, (end() - p - 1)*sizeof(ComponentHandle));
+        --mSize;
+        return p;
+    }
+
+    inline ComponentHandleList::~ComponentHandleList()
+    {
+        if (mCapacity > INLINE_CAPACITY)
+            mResource->deallocate(mHeap, mCapacity*sizeof(ComponentHandle), alignof(ComponentHandle));
+    }
+
+
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::ChunkedArray(MemoryResource* resource)
+        : mResource(resource), mBlockResource(resource), mBlocks(ResourceAllocator<MemoryBlock>(resource)),
+          mPolicy(ReusePolicy::FREE_ORDER), mFreeHead(ChunkedArrayHandle::null()), mFreeTail(ChunkedArrayHandle::null()),
+          mFreeBlock(NO_BLOCK), mFreeCount(0), mCurrentBlock(0), mReleasedCount(1), mIdleCount(0)
+    {
+        mBlocks.emplace_back(); //without memory, the first add allocates it
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    template<typename ...PARAM>
+    ChunkedArrayHandle ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::add(PARAM&&... param)
+    {
+        ChunkedArrayHandle h;
+        if (mFreeCount > REUSE_C) //reuse a previously abadoned slot
+        {
+            h = popFree();
+        }
+        else
+        {
+            if (!mBlocks[mCurrentBlock].ptr || mBlocks[mCurrentBlock].endIndex >= BLOCK_SIZE) //need a new block
+                openBlock();
+            h.block = mCurrentBlock;
+            h.index = mBlocks[mCurrentBlock].endIndex++;
+        }
+        ++(mBlocks[h.block].contentCount);
+        mBlocks[h.block].occupancy[h.index / WORD_BITS] |= uint64_t(1) << (h.index % WORD_BITS);
+        ::new (static_cast<void*>(mBlocks[h.block].at(h.index))) T( std::forward<PARAM>(param)... );  //construct component C in place
+        return h;
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    template<typename ...PARAM>
+    ChunkedArrayRangeVector ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::addN(std::size_t n, const PARAM&... param)
+    {
+        ChunkedArrayRangeVector ranges{ ResourceAllocator<ChunkedArrayRange>(mResource) };
+        //nothing to keep in place, start over with fresh slots, unless freed slots must wait for REUSE_C
+        if (REUSE_C == 0 && n > 0 && size() == 0 && mFreeCount > 0)
+            rewind();
+        while (n > 0)
+        {
+            MemoryBlock& current = mBlocks[mCurrentBlock];
+            if (current.ptr && current.endIndex < BLOCK_SIZE) //fresh tail, take as much as possible at once
+            {
+                const std::size_t count = std::min(n, BLOCK_SIZE - current.endIndex);
+                const std::size_t first = current.endIndex;
+                current.endIndex += count;
+                constructRange(mCurrentBlock, first, count, param...);
+                ranges.emplace_back(mCurrentBlock, first, count);
+                n -= count;
+            }
+            else if (mFreeCount > REUSE_C) //same rule as add
+            {
+                ChunkedArrayHandle h = popFree();
+                constructRange(h.block, h.index, 1, param...);
+                ChunkedArrayRange* last = ranges.empty() || ranges.back().block != h.block ? nullptr : &ranges.back();
+                if (last && last->first + last->count == h.index) //grow upwards
+                {
+                    ++last->count;
+                }
+                else if (last && h.index + 1 == last->first) //grow downwards, e.g. a stack handing out a freed run
+                {
+                    --last->first;
+                    ++last->count;
+                }
+                else
+                {
+                    ranges.emplace_back(h.block, h.index, 1);
+                }
+                --n;
+            }
+            else
+            {
+                openBlock();
+            }
+        }
+        return ranges;
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    template<typename ...PARAM>
+    void ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::constructRange(std::size_t b, std::size_t first, std::size_t count, const PARAM&... param)
+    {
+        MemoryBlock& block = mBlocks[b];
+        for (std::size_t i = first; i < first + count; ++i)
+            ::new (static_cast<void*>(block.at(i))) T( param... );
+        markRange(block, first, count, true);
+        block.contentCount += count;
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    void ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::markRange(MemoryBlock& block, std::size_t first, std::size_t count, bool value)
+    {
+        const std::size_t end = first + count;
+        std::size_t i = first;
+        while (i < end)
+        {
+            const std::size_t bit = i % WORD_BITS;
+            const std::size_t length = std::min(WORD_BITS - bit, end - i);
+            const uint64_t mask = (length == WORD_BITS ? ~uint64_t(0) : (uint64_t(1) << length) - 1) << bit;
+            if (value)
+                block.occupancy[i / WORD_BITS] |= mask;
+            else
+                block.occupancy[i / WORD_BITS] &= ~mask;
+            i += length;
+        }
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    void ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::destroyMany(const ChunkedArrayHandle* handles, std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+            destroy(handles[i]); //the class is final, so this is a direct call
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    void ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::destroyN(const ChunkedArrayRange& range)
+    {
+        MemoryBlock& block = mBlocks[range.block];
+        if (!std::is_trivially_destructible<T>::value)
+        {
+            for (std::size_t i = range.first; i < std::size_t(range.first + range.count); ++i)
+                block.at(i)->~T();
+        }
+        markRange(block, range.first, range.count, false);
+        block.contentCount -= range.count;
+        if (mPolicy == ReusePolicy::FREE_ORDER && REUSE_C > 0) //queue: keep the order of the range
+        {
+            for (std::size_t i = 0; i < range.count; ++i)
+                pushFree(range.handle(i));
+        }
+        else //stacks: push backwards, so the range is reused from its start
+        {
+            for (std::size_t i = range.count; i-- > 0;)
+                pushFree(range.handle(i));
+        }
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    void ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::destroyN(const ChunkedArrayRangeVector& ranges)
+    {
+        for (const auto& range : ranges)
+            destroyN(range);
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    T& ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::get(ChunkedArrayHandle h)
+    {
+        if (MAX_BLOCKS > 0)
+            return *reinterpret_cast<T*>(mRange.base() + h.block*FLAT_STRIDE + h.index*sizeof(Slot));
+        return *mBlocks[h.block].at(h.index);
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    const T& ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::get(ChunkedArrayHandle h) const
+    {
+        if (MAX_BLOCKS > 0)
+            return *reinterpret_cast<const T*>(mRange.base() + h.block*FLAT_STRIDE + h.index*sizeof(Slot));
+        return *mBlocks[h.block].at(h.index);
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    void ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::destroy(ChunkedArrayHandle h)
+    {
+        --(mBlocks[h.block].contentCount);
+        mBlocks[h.block].occupancy[h.index / WORD_BITS] &= ~(uint64_t(1) << (h.index % WORD_BITS));
+        if (!std::is_trivially_destructible<T>::value)
+            mBlocks[h.block].at(h.index)->~T();
+        pushFree(h); //the slot is dead now, its memory holds the link
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    ChunkedArrayHandle ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::readLink(ChunkedArrayHandle h) const
+    {
+        ChunkedArrayHandle next;
+        std::memcpy(&next, mBlocks[h.block].ptr[h.index].bytes, sizeof(ChunkedArrayHandle));
+        return next;
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    void ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::writeLink(ChunkedArrayHandle h, ChunkedArrayHandle next)
+    {
+        std::memcpy(mBlocks[h.block].ptr[h.index].bytes, &next, sizeof(ChunkedArrayHandle));
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    void ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::pushFree(ChunkedArrayHandle h)
+    {
+        if (mPolicy != ReusePolicy::FREE_ORDER) //per-block stack
+        {
+            MemoryBlock& block = mBlocks[h.block];
+            writeLink(h, ChunkedArrayHandle(h.block, block.freeHead));
+            block.freeHead = h.index;
+            if (preferBlock(h.block, mFreeBlock))
+                mFreeBlock = h.block;
+        }
+        else if (REUSE_C == 0) //stack: only the freed slot is touched
+        {
+            writeLink(h, mFreeHead);
+            mFreeHead = h;
+        }
+        else //queue: append behind the most recently freed slot
+        {
+            writeLink(h, ChunkedArrayHandle::null());
+            if (mFreeTail)
+                writeLink(mFreeTail, h);
+            else
+                mFreeHead = h;
+            mFreeTail = h;
+        }
+        ++mFreeCount;
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    ChunkedArrayHandle ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::popFree()
+    {
+        ChunkedArrayHandle h;
+        if (mPolicy != ReusePolicy::FREE_ORDER)
+        {
+            if (mFreeBlock == NO_BLOCK || mBlocks[mFreeBlock].freeHead == NULL_INDEX)
+                selectFreeBlock();
+            MemoryBlock& block = mBlocks[mFreeBlock];
+            h = ChunkedArrayHandle(mFreeBlock, block.freeHead);
+            block.freeHead = readLink(h).index;
+        }
+        else
+        {
+            h = mFreeHead;
+            mFreeHead = readLink(h);
+            if (!mFreeHead)
+                mFreeTail = ChunkedArrayHandle::null();
+        }
+        --mFreeCount;
+        return h;
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    bool ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::preferBlock(std::size_t candidate, std::size_t current) const
+    {
+        if (current == NO_BLOCK || mBlocks[current].freeHead == NULL_INDEX)
+            return true;
+        if (mPolicy == ReusePolicy::LOWEST_BLOCK)
+            return candidate < current;
+        return mBlocks[candidate].contentCount > mBlocks[current].contentCount;
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    void ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::selectFreeBlock()
+    {
+        //the lowest block with free slots is never below the current one, the fullest one can be anywhere
+        std::size_t b = (mPolicy == ReusePolicy::LOWEST_BLOCK && mFreeBlock != NO_BLOCK) ? mFreeBlock : 0;
+        mFreeBlock = NO_BLOCK;
+        for (; b < mBlocks.size(); ++b)
+        {
+            if (mBlocks[b].freeHead != NULL_INDEX && preferBlock(b, mFreeBlock))
+            {
+                mFreeBlock = b;
+                if (mPolicy == ReusePolicy::LOWEST_BLOCK)
+                    return;
+            }
+        }
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    void ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::rebuildFreeList()
+    {
+        const bool global = mPolicy == ReusePolicy::FREE_ORDER;
+        mFreeHead = ChunkedArrayHandle::null();
+        mFreeTail = ChunkedArrayHandle::null();
+        mFreeBlock = NO_BLOCK;
+        mFreeCount = 0;
+
+        ChunkedArrayHandle tail = ChunkedArrayHandle::null();
+        for (std::size_t b = 0; b < mBlocks.size(); ++b)
+        {
+            MemoryBlock& block = mBlocks[b];
+            block.freeHead = NULL_INDEX;
+            if (!global)
+                tail = ChunkedArrayHandle::null();
+
+            const std::size_t words = block.usedWords();
+            for (std::size_t w = 0; w < words; ++w)
+            {
+                uint64_t dead = ~block.occupancy[w];
+                if ((w+1)*WORD_BITS > block.endIndex) //mask out the slots past the end index
+                    dead &= (uint64_t(1) << (block.endIndex % WORD_BITS)) - 1;
+                while (dead)
+                {
+                    //append, so the lists run in address order
+                    ChunkedArrayHandle h(b, w*WORD_BITS + countTrailingZeros(dead));
+                    writeLink(h, ChunkedArrayHandle::null());
+                    if (tail)
+                        writeLink(tail, h);
+                    else if (global)
+                        mFreeHead = h;
+                    else
+                        block.freeHead = h.index;
+                    tail = h;
+                    ++mFreeCount;
+                    dead &= dead - 1;
+                }
+            }
+            if (!global && block.freeHead != NULL_INDEX && preferBlock(b, mFreeBlock))
+                mFreeBlock = b;
+        }
+        if (global)
+            mFreeTail = tail;
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    void ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::unlinkEmptyBlocks()
+    {
+        auto empty = [this](std::size_t b) { return mBlocks[b].ptr && mBlocks[b].contentCount == 0; };
+        if (mPolicy != ReusePolicy::FREE_ORDER) //a list per block, every slot below the end index is free
+        {
+            for (std::size_t b = 0; b < mBlocks.size(); ++b)
+            {
+                if (empty(b) && mBlocks[b].freeHead != NULL_INDEX)
+                {
+                    mFreeCount -= mBlocks[b].endIndex;
+                    mBlocks[b].freeHead = NULL_INDEX;
+                }
+            }
+            selectFreeBlock();
+            return;
+        }
+
+        //skip the slots of empty blocks, the others stay in the order they were freed
+        ChunkedArrayHandle h = mFreeHead;
+        ChunkedArrayHandle kept = ChunkedArrayHandle::null();
+        mFreeHead = ChunkedArrayHandle::null();
+        while (h)
+        {
+            ChunkedArrayHandle next = readLink(h);
+            if (empty(h.block))
+                --mFreeCount;
+            else
+            {
+                if (kept)
+                    writeLink(kept, h);
+                else
+                    mFreeHead = h;
+                kept = h;
+            }
+            h = next;
+        }
+        if (kept)
+            writeLink(kept, ChunkedArrayHandle::null());
+        mFreeTail = kept;
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    ChunkedArrayHandle ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::nextHole(std::size_t& block, std::size_t& word) const
+    {
+        for (; block < mBlocks.size(); ++block, word = 0)
+        {
+            const MemoryBlock& b = mBlocks[block];
+            if (b.contentCount == b.endIndex) continue; //no holes in this block
+            for (; word < b.usedWords(); ++word)
+            {
+                uint64_t dead = ~b.occupancy[word];
+                if ((word+1)*WORD_BITS > b.endIndex)
+                    dead &= (uint64_t(1) << (b.endIndex % WORD_BITS)) - 1;
+                if (dead)
+                    return ChunkedArrayHandle(block, word*WORD_BITS + countTrailingZeros(dead));
+            }
+        }
+        return ChunkedArrayHandle::null();
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    void ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::relocate(ChunkedArrayHandle from, ChunkedArrayHandle to)
+    {
+        MemoryBlock& src = mBlocks[from.block];
+        MemoryBlock& dst = mBlocks[to.block];
+        ::new (static_cast<void*>(dst.at(to.index))) T( std::move(*src.at(from.index)) );
+        ++dst.contentCount;
+        dst.occupancy[to.index / WORD_BITS] |= uint64_t(1) << (to.index % WORD_BITS);
+        src.at(from.index)->~T();
+        --src.contentCount;
+        src.occupancy[from.index / WORD_BITS] &= ~(uint64_t(1) << (from.index % WORD_BITS));
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    void ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::openBlock()
+    {
+        if (mIdleCount > 0) //use a block that has memory already
+        {
+            for (std::size_t b = 0; b < mBlocks.size(); ++b)
+            {
+                if (mBlocks[b].ptr && mBlocks[b].endIndex == 0 && b != mCurrentBlock)
+                {
+                    --mIdleCount;
+                    mCurrentBlock = b;
+                    return;
+                }
+            }
+        }
+        if (mReleasedCount > 0) //refill the memory of a released block
+        {
+            for (std::size_t b = 0; b < mBlocks.size(); ++b)
+            {
+                if (!mBlocks[b].ptr)
+                {
+                    mBlocks[b].ptr = allocateBlock(b);
+                    --mReleasedCount;
+                    mCurrentBlock = b;
+                    return;
+                }
+            }
+        }
+        appendBlock();
+        mCurrentBlock = mBlocks.size() - 1;
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    void ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::appendBlock()
+    {
+        //a handle addresses at most one block per SubID value
+        if (mBlocks.size() > std::numeric_limits<SubID>::max())
+            throw std::length_error("A ChunkedArray can not hold more blocks than a SubID can address.");
+        //grow the list first, so the block memory can not leak once it is allocated
+        if (mBlocks.size() == mBlocks.capacity())
+            mBlocks.reserve(2*mBlocks.size());
+        Slot* ptr = allocateBlock(mBlocks.size());
+        mBlocks.emplace_back();
+        mBlocks.back().ptr = ptr;
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    typename ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::Slot* ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::allocateBlock(std::size_t b)
+    {
+        if (MAX_BLOCKS == 0)
+            return static_cast<Slot*>( mBlockResource->allocate(BLOCK_BYTES, BLOCK_ALIGNMENT) );
+        if (b >= MAX_BLOCKS)
+            throw std::bad_alloc();
+        if (!mRange.base())
+            mRange.reserve(MAX_BLOCKS*FLAT_STRIDE, BLOCK_ALIGNMENT);
+        char* p = mRange.base() + b*FLAT_STRIDE;
+        mRange.commit(p, BLOCK_BYTES);
+        return reinterpret_cast<Slot*>(p);
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    void ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::deallocateBlock(Slot* ptr)
+    {
+        if (MAX_BLOCKS == 0)
+            mBlockResource->deallocate(ptr, BLOCK_BYTES, BLOCK_ALIGNMENT);
+        else
+            mRange.decommit(reinterpret_cast<char*>(ptr), BLOCK_BYTES);
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    void ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::clear()
+    {
+        if (!std::is_trivially_destructible<T>::value)
+            forEach([] (T& element) { element.~T(); });
+        for (auto& block : mBlocks)
+        {
+            std::fill(block.occupancy.begin(), block.occupancy.begin() + block.usedWords(), 0);
+            block.contentCount = 0;
+        }
+        rewind();
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    void ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::rewind()
+    {
+        mIdleCount = 0;
+        for (auto& block : mBlocks)
+        {
+            block.endIndex = 0;
+            if (block.ptr)
+                ++mIdleCount;
+        }
+        rebuildFreeList(); //nothing below the end indices anymore, so this just clears the lists
+        if (mIdleCount > 0)
+        {
+            mCurrentBlock = NO_BLOCK; //every block with memory is idle now, openBlock takes the first one
+            openBlock();
+        }
+        else
+        {
+            mCurrentBlock = 0; //no memory at all, the next add refills a released block
+        }
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    std::size_t ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::releaseEmptyBlocks()
+    {
+        std::size_t released = 0;
+        for (std::size_t b = 0; b < mBlocks.size(); ++b)
+        {
+            MemoryBlock& block = mBlocks[b];
+            if (block.ptr && block.contentCount == 0)
+            {
+                if (block.endIndex == 0 && b != mCurrentBlock)
+                    --mIdleCount;
+                deallocateBlock(block.ptr);
+                block.ptr = nullptr;
+                block.endIndex = 0;
+                ++released;
+                ++mReleasedCount;
+            }
+        }
+        //released blocks at the end can go completely, but one entry always stays
+        while (mBlocks.size() > 1 && !mBlocks.back().ptr)
+        {
+            mBlocks.pop_back();
+            --mReleasedCount;
+        }
+        if (mCurrentBlock >= mBlocks.size())
+        {
+            mCurrentBlock = mBlocks.size() - 1;
+            if (mBlocks[mCurrentBlock].ptr && mBlocks[mCurrentBlock].endIndex == 0) //an idle block became the current one
+                --mIdleCount;
+        }
+        return released;
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    std::size_t ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::trim()
+    {
+        unlinkEmptyBlocks(); //the links live in the blocks, so before they are released
+        return releaseEmptyBlocks();
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    std::size_t ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::compact(HandleRefVector& refs, std::size_t budget)
+    {
+        auto position = [](const ChunkedArrayHandle* h) { return std::size_t(h->block)*BLOCK_SIZE + h->index; };
+        auto highestFirst = [&position](const ChunkedArrayHandle* a, const ChunkedArrayHandle* b) { return position(a) > position(b); };
+        //only the budget highest elements can move in this call
+        const std::size_t candidates = std::min(budget, refs.size());
+        std::partial_sort(refs.begin(), refs.begin() + candidates, refs.end(), highestFirst);
+
+        std::size_t moved = 0;
+        std::size_t holeBlock = 0;
+        std::size_t holeWord = 0;
+        for (std::size_t i = 0; i < candidates; ++i)
+        {
+            ChunkedArrayHandle hole = nextHole(holeBlock, holeWord);
+            if (!hole || position(&hole) >= position(refs[i]))
+                break; //everything below is packed already
+            relocate(*refs[i], hole);
+            *refs[i] = hole;
+            ++moved;
+        }
+        if (moved > 0)
+        {
+            releaseEmptyBlocks();
+            rebuildFreeList();
+        }
+        return moved;
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    void ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::setBlockResource(MemoryResource* resource)
+    {
+        if (size() > 0)
+            throw std::logic_error("The block resource of a ChunkedArray can only be changed while it is empty.");
+        releaseEmptyBlocks(); //all blocks are empty, the next add opens a block from the new resource
+        rebuildFreeList();
+        mBlockResource = resource;
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    void ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::setReusePolicy(ReusePolicy policy)
+    {
+        if (policy == mPolicy)
+            return;
+        mPolicy = policy;
+        rebuildFreeList();
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    std::size_t ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::blockCount() const
+    {
+        return mBlocks.size() - mReleasedCount;
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    std::size_t ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::capacity() const
+    {
+        const MemoryBlock& current = mBlocks[mCurrentBlock];
+        const std::size_t fresh = (current.ptr ? BLOCK_SIZE - current.endIndex : 0) + mIdleCount*BLOCK_SIZE;
+        const std::size_t reusable = mFreeCount > REUSE_C ? mFreeCount - REUSE_C : 0; //the last REUSE_C freed slots are held back
+        return size() + reusable + fresh;
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    void ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::reserve(std::size_t n)
+    {
+        std::size_t available = capacity();
+        for (std::size_t b = 0; b < mBlocks.size() && available < n; ++b) //refill released blocks first
+        {
+            if (!mBlocks[b].ptr)
+            {
+                mBlocks[b].ptr = allocateBlock(b);
+                --mReleasedCount;
+                if (b != mCurrentBlock)
+                    ++mIdleCount;
+                available += BLOCK_SIZE;
+            }
+        }
+        while (available < n)
+        {
+            appendBlock();
+            ++mIdleCount;
+            available += BLOCK_SIZE;
+        }
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    std::size_t ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::size() const
+    {
+        std::size_t sum = 0;
+        for (const auto& block : mBlocks)
+            sum += block.contentCount;
+        return sum;
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    bool ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::alive(ChunkedArrayHandle h) const
+    {
+        return h.block < mBlocks.size() &&
+               (mBlocks[h.block].occupancy[h.index / WORD_BITS] >> (h.index % WORD_BITS)) & 1u;
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    template<typename F>
+    void ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::forEach(F f)
+    {
+        for (auto& block : mBlocks)
+        {
+            if (block.contentCount == 0) continue;
+            const std::size_t words = block.usedWords();
+            for (std::size_t w = 0; w < words; ++w)
+            {
+                uint64_t bits = block.occupancy[w];
+                while (bits)
+                {
+                    f(*block.at(w*WORD_BITS + countTrailingZeros(bits)));
+                    bits &= bits - 1;
+                }
+            }
+        }
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    template<typename F>
+    void ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::forEach(F f) const
+    {
+        for (const auto& block : mBlocks)
+        {
+            if (block.contentCount == 0) continue;
+            const std::size_t words = block.usedWords();
+            for (std::size_t w = 0; w < words; ++w)
+            {
+                uint64_t bits = block.occupancy[w];
+                while (bits)
+                {
+                    f(static_cast<const T&>(*block.at(w*WORD_BITS + countTrailingZeros(bits))));
+                    bits &= bits - 1;
+                }
+            }
+        }
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    typename ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::iterator ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::begin()
+    {
+        return iterator(&mBlocks, 0);
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    typename ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::iterator ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::end()
+    {
+        return iterator(&mBlocks, mBlocks.size());
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    typename ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::const_iterator ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::begin() const
+    {
+        return const_iterator(&mBlocks, 0);
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    typename ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::const_iterator ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::end() const
+    {
+        return const_iterator(&mBlocks, mBlocks.size());
+    }
+
+    template<typename T, std::size_t BLOCK_SIZE, std::size_t REUSE_C, std::size_t ALIGNMENT, std::size_t MAX_BLOCKS>
+    ChunkedArray<T, BLOCK_SIZE, REUSE_C, ALIGNMENT, MAX_BLOCKS>::~ChunkedArray()
+    {
+        for (const auto& block : mBlocks)
+        {
+            if (block.ptr)
+                deallocateBlock(block.ptr);
+        }
+    }
+
+    template<typename C, typename LAYOUT, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    SoAChunkedArray<C, LAYOUT, BLOCK_SIZE, REUSE_C>::SoAChunkedArray(MemoryResource* resource)
+        : mRows(resource), mBlockResource(resource), mFields(ResourceAllocator<FieldBlock>(resource)) {}
+
+    template<typename C, typename LAYOUT, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    template<typename ...PARAM>
+    ChunkedArrayHandle SoAChunkedArray<C, LAYOUT, BLOCK_SIZE, REUSE_C>::add(PARAM&&... param)
+    {
+        const C value(std::forward<PARAM>(param)...);
+        ChunkedArrayHandle h = mRows.add();
+        char* data = fieldBlock(h.block);
+        ++mFields[h.block].count;
+        store(Fields(), data, h.index, 1, value);
+        return h;
+    }
+
+    template<typename C, typename LAYOUT, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    template<typename ...PARAM>
+    ChunkedArrayRangeVector SoAChunkedArray<C, LAYOUT, BLOCK_SIZE, REUSE_C>::addN(std::size_t n, const PARAM&... param)
+    {
+        const C value(param...);
+        ChunkedArrayRangeVector ranges = mRows.addN(n);
+        for (const auto& range : ranges)
+        {
+            char* data = fieldBlock(range.block);
+            mFields[range.block].count += range.count;
+            store(Fields(), data, range.first, range.count, value);
+        }
+        return ranges;
+    }
+
+    template<typename C, typename LAYOUT, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    typename SoAChunkedArray<C, LAYOUT, BLOCK_SIZE, REUSE_C>::reference SoAChunkedArray<C, LAYOUT, BLOCK_SIZE, REUSE_C>::get(ChunkedArrayHandle h)
+    {
+        return reference(mFields[h.block].data, h.index);
+    }
+
+    template<typename C, typename LAYOUT, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    typename SoAChunkedArray<C, LAYOUT, BLOCK_SIZE, REUSE_C>::const_reference SoAChunkedArray<C, LAYOUT, BLOCK_SIZE, REUSE_C>::get(ChunkedArrayHandle h) const
+    {
+        return const_reference(mFields[h.block].data, h.index);
+    }
+
+    template<typename C, typename LAYOUT, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    void SoAChunkedArray<C, LAYOUT, BLOCK_SIZE, REUSE_C>::prefetch(ChunkedArrayHandle h) const
+    {
+        prefetch(Fields(), mFields[h.block].data, h.index);
+    }
+
+    template<typename C, typename LAYOUT, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    void SoAChunkedArray<C, LAYOUT, BLOCK_SIZE, REUSE_C>::destroy(ChunkedArrayHandle h)
+    {
+        mRows.destroy(h);
+        --mFields[h.block].count;
+    }
+
+    template<typename C, typename LAYOUT, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    void SoAChunkedArray<C, LAYOUT, BLOCK_SIZE, REUSE_C>::destroyMany(const ChunkedArrayHandle* handles, std::size_t count)
+    {
+        mRows.destroyMany(handles, count);
+        for (std::size_t i = 0; i < count; ++i)
+            --mFields[handles[i].block].count;
+    }
+
+    template<typename C, typename LAYOUT, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    void SoAChunkedArray<C, LAYOUT, BLOCK_SIZE, REUSE_C>::clear()
+    {
+        mRows.clear();
+        for (auto& block : mFields)
+            block.count = 0;
+    }
+
+    template<typename C, typename LAYOUT, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    std::size_t SoAChunkedArray<C, LAYOUT, BLOCK_SIZE, REUSE_C>::trim()
+    {
+        std::size_t released = mRows.trim();
+        releaseEmptyFieldBlocks();
+        return released;
+    }
+
+    template<typename C, typename LAYOUT, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    std::size_t SoAChunkedArray<C, LAYOUT, BLOCK_SIZE, REUSE_C>::compact(HandleRefVector& refs, std::size_t budget)
+    {
+        //mRows.compact reorders refs, so remember each old handle together with its reference
+        using Entry = std::pair<ChunkedArrayHandle*, ChunkedArrayHandle>;
+        std::vector< Entry, ResourceAllocator<Entry> > before{ ResourceAllocator<Entry>(refs.get_allocator()) };
+        before.reserve(refs.size());
+        for (auto ref : refs)
+            before.emplace_back(ref, *ref);
+        std::size_t moved = mRows.compact(refs, budget);
+        if (moved == 0)
+            return 0;
+
+        //gather all moved elements first, a new position may be the old position of another one
+        std::vector< C, ResourceAllocator<C> > values{ ResourceAllocator<C>(refs.get_allocator()) };
+        values.reserve(moved);
+        for (const auto& entry : before)
+        {
+            if (*entry.first != entry.second)
+                values.push_back( get(entry.second) );
+        }
+        std::size_t next = 0;
+        for (const auto& entry : before)
+        {
+            const ChunkedArrayHandle to = *entry.first;
+            if (to != entry.second)
+            {
+                --mFields[entry.second.block].count;
+                char* data = fieldBlock(to.block);
+                ++mFields[to.block].count;
+                store(Fields(), data, to.index, 1, values[next++]);
+            }
+        }
+        releaseEmptyFieldBlocks();
+        return moved;
+    }
+
+    template<typename C, typename LAYOUT, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    void SoAChunkedArray<C, LAYOUT, BLOCK_SIZE, REUSE_C>::reserve(std::size_t n)
+    {
+        mRows.reserve(n);
+        for (std::size_t b = 0; b < mRows.slotCount() / BLOCK_SIZE; ++b)
+            fieldBlock(b);
+    }
+
+    template<typename C, typename LAYOUT, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    void SoAChunkedArray<C, LAYOUT, BLOCK_SIZE, REUSE_C>::setBlockResource(MemoryResource* resource)
+    {
+        if (size() > 0)
+            throw std::logic_error("The block resource of a SoAChunkedArray can only be changed while it is empty.");
+        releaseEmptyFieldBlocks();
+        mBlockResource = resource;
+    }
+
+    template<typename C, typename LAYOUT, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    template<typename F>
+    void SoAChunkedArray<C, LAYOUT, BLOCK_SIZE, REUSE_C>::forEach(F f)
+    {
+        for (auto it = mRows.begin(); it != mRows.end(); ++it)
+            f(get(it.handle()));
+    }
+
+    template<typename C, typename LAYOUT, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    template<typename F>
+    void SoAChunkedArray<C, LAYOUT, BLOCK_SIZE, REUSE_C>::forEach(F f) const
+    {
+        for (auto it = mRows.begin(); it != mRows.end(); ++it)
+            f(get(it.handle()));
+    }
+
+    template<typename C, typename LAYOUT, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    template<typename F>
+    void SoAChunkedArray<C, LAYOUT, BLOCK_SIZE, REUSE_C>::forEachBlock(F f)
+    {
+        for (std::size_t b = 0; b < mFields.size(); ++b)
+        {
+            if (mFields[b].count > 0)
+                f(BlockView(mFields[b].data, b, mRows.blockEnd(b)));
+        }
+    }
+
+    template<typename C, typename LAYOUT, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    template<std::size_t ... I>
+    void SoAChunkedArray<C, LAYOUT, BLOCK_SIZE, REUSE_C>::store(std::index_sequence<I...>, char* data, std::size_t first, std::size_t count, const C& value)
+    {
+        int expand[] = { 0, (std::fill_n(fieldArray<I>(data) + first, count, LAYOUT::template Field<I>::of(value)), 0)... };
+        (void)expand;
+    }
+
+    template<typename C, typename LAYOUT, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    template<std::size_t ... I>
+    void SoAChunkedArray<C, LAYOUT, BLOCK_SIZE, REUSE_C>::load(std::index_sequence<I...>, char* data, std::size_t index, C& value)
+    {
+        int expand[] = { 0, (LAYOUT::template Field<I>::of(value) = fieldArray<I>(data)[index], 0)... };
+        (void)expand;
+    }
+
+    template<typename C, typename LAYOUT, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    template<std::size_t ... I>
+    void SoAChunkedArray<C, LAYOUT, BLOCK_SIZE, REUSE_C>::prefetch(std::index_sequence<I...>, char* data, std::size_t index)
+    {
+        int expand[] = { 0, (dom::prefetch(fieldArray<I>(data) + index), 0)... };
+        (void)expand;
+    }
+
+    template<typename C, typename LAYOUT, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    char* SoAChunkedArray<C, LAYOUT, BLOCK_SIZE, REUSE_C>::fieldBlock(std::size_t b)
+    {
+        if (b >= mFields.size())
+            mFields.resize(b + 1, FieldBlock{nullptr, 0});
+        if (!mFields[b].data)
+        {
+            mFields[b].data = static_cast<char*>( mBlockResource->allocate(BLOCK_BYTES, CACHE_LINE_SIZE) );
+            std::memset(mFields[b].data, 0, BLOCK_BYTES); //block kernels may read slots that were never handed out
+        }
+        return mFields[b].data;
+    }
+
+    template<typename C, typename LAYOUT, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    void SoAChunkedArray<C, LAYOUT, BLOCK_SIZE, REUSE_C>::releaseEmptyFieldBlocks()
+    {
+        for (auto& block : mFields)
+        {
+            if (block.data && block.count == 0)
+            {
+                mBlockResource->deallocate(block.data, BLOCK_BYTES, CACHE_LINE_SIZE);
+                block.data = nullptr;
+            }
+        }
+    }
+
+    template<typename C, typename LAYOUT, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    SoAChunkedArray<C, LAYOUT, BLOCK_SIZE, REUSE_C>::~SoAChunkedArray()
+    {
+        for (const auto& block : mFields)
+        {
+            if (block.data)
+                mBlockResource->deallocate(block.data, BLOCK_BYTES, CACHE_LINE_SIZE);
+        }
+    }
+
+
+
+    template<typename HOT, typename COLD, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    SplitChunkedArray<HOT, COLD, BLOCK_SIZE, REUSE_C>::SplitChunkedArray(MemoryResource* resource)
+        : mHot(resource), mCold(resource) {}
+
+    template<typename HOT, typename COLD, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    ChunkedArrayHandle SplitChunkedArray<HOT, COLD, BLOCK_SIZE, REUSE_C>::add()
+    {
+        return add(HOT(), COLD());
+    }
+
+    template<typename HOT, typename COLD, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    template<typename H, typename CD>
+    ChunkedArrayHandle SplitChunkedArray<HOT, COLD, BLOCK_SIZE, REUSE_C>::add(H&& hot, CD&& cold)
+    {
+        ChunkedArrayHandle h = mHot.add(std::forward<H>(hot));
+        try
+        {
+            mCold.add(std::forward<CD>(cold));
+        }
+        catch (...)
+        {
+            mHot.destroy(h);
+            throw;
+        }
+        return h;
+    }
+
+    template<typename HOT, typename COLD, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    ChunkedArrayHandle SplitChunkedArray<HOT, COLD, BLOCK_SIZE, REUSE_C>::add(const SplitComponent<HOT, COLD>& value)
+    {
+        return add(value.hot, value.cold);
+    }
+
+    template<typename HOT, typename COLD, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    template<bool CONST>
+    ChunkedArrayHandle SplitChunkedArray<HOT, COLD, BLOCK_SIZE, REUSE_C>::add(const BasicReference<CONST>& other)
+    {
+        return add(other.hot(), other.cold());
+    }
+
+    template<typename HOT, typename COLD, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    ChunkedArrayRangeVector SplitChunkedArray<HOT, COLD, BLOCK_SIZE, REUSE_C>::addN(std::size_t n)
+    {
+        ChunkedArrayRangeVector ranges = mHot.addN(n);
+        try
+        {
+            mCold.addN(n);
+        }
+        catch (...)
+        {
+            mHot.destroyN(ranges);
+            throw;
+        }
+        return ranges;
+    }
+
+    template<typename HOT, typename COLD, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    void SplitChunkedArray<HOT, COLD, BLOCK_SIZE, REUSE_C>::destroy(ChunkedArrayHandle h)
+    {
+        mHot.destroy(h);
+        mCold.destroy(h);
+    }
+
+    template<typename HOT, typename COLD, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    void SplitChunkedArray<HOT, COLD, BLOCK_SIZE, REUSE_C>::destroyMany(const ChunkedArrayHandle* handles, std::size_t count)
+    {
+        mHot.destroyMany(handles, count);
+        mCold.destroyMany(handles, count);
+    }
+
+    template<typename HOT, typename COLD, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    void SplitChunkedArray<HOT, COLD, BLOCK_SIZE, REUSE_C>::clear()
+    {
+        mHot.clear();
+        mCold.clear();
+    }
+
+    template<typename HOT, typename COLD, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    std::size_t SplitChunkedArray<HOT, COLD, BLOCK_SIZE, REUSE_C>::trim()
+    {
+        return mHot.trim() + mCold.trim();
+    }
+
+    template<typename HOT, typename COLD, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    std::size_t SplitChunkedArray<HOT, COLD, BLOCK_SIZE, REUSE_C>::compact(HandleRefVector& refs, std::size_t budget)
+    {
+        //both arrays hold the same slots, so compacting the cold array with copies of the handles
+        //makes exactly the same moves as compacting the hot array with the real ones
+        std::vector< ChunkedArrayHandle, ResourceAllocator<ChunkedArrayHandle> > coldHandles{ ResourceAllocator<ChunkedArrayHandle>(refs.get_allocator()) };
+        coldHandles.reserve(refs.size());
+        for (auto ref : refs)
+            coldHandles.push_back(*ref);
+        HandleRefVector coldRefs(refs.get_allocator());
+        coldRefs.reserve(refs.size());
+        for (auto& h : coldHandles)
+            coldRefs.push_back(&h);
+        mCold.compact(coldRefs, budget);
+        return mHot.compact(refs, budget);
+    }
+
+    template<typename HOT, typename COLD, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    void SplitChunkedArray<HOT, COLD, BLOCK_SIZE, REUSE_C>::reserve(std::size_t n)
+    {
+        mHot.reserve(n);
+        mCold.reserve(n);
+    }
+
+    template<typename HOT, typename COLD, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    void SplitChunkedArray<HOT, COLD, BLOCK_SIZE, REUSE_C>::setReusePolicy(ReusePolicy policy)
+    {
+        mHot.setReusePolicy(policy);
+        mCold.setReusePolicy(policy);
+    }
+
+    template<typename HOT, typename COLD, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    void SplitChunkedArray<HOT, COLD, BLOCK_SIZE, REUSE_C>::setBlockResource(MemoryResource* resource)
+    {
+        mHot.setBlockResource(resource);
+        mCold.setBlockResource(resource);
+    }
+
+    template<typename HOT, typename COLD, std::size_t BLOCK_SIZE, std::size_t REUSE_C>
+    template<typename F>
+    void SplitChunkedArray<HOT, COLD, BLOCK_SIZE, REUSE_C>::forEach(F f)
+    {
+        for (auto it = mHot.begin(); it != mHot.end(); ++it)
+            f(get(it.handle()));
+    }
+
+
+
+    template<typename T>
+    PackedArray<T>::PackedArray(MemoryResource* resource)
+        : mBlockResource(resource), mValues(nullptr), mSize(0), mCapacity(0), mSlots(resource), mOwners(resource), mFreeSlots(resource) {}
+
+    template<typename T>
+    PackedArray<T>::~PackedArray()
+    {
+        if (mValues)
+            mBlockResource->deallocate(mValues, mCapacity * sizeof(T), alignof(T));
+    }
+
+    template<typename T>
+    std::uint32_t PackedArray<T>::newSlot()
+    {
+        std::uint32_t slot;
+        if (mFreeSlots.empty())
+        {
+            slot = static_cast<std::uint32_t>(mSlots.size());
+            mSlots.push_back(0);
+        }
+        else
+        {
+            slot = mFreeSlots.back();
+            mFreeSlots.pop_back();
+        }
+        mSlots[slot] = static_cast<std::uint32_t>(mSize);
+        mOwners.push_back(slot);
+        return slot;
+    }
+
+    template<typename T>
+    void PackedArray<T>::reserveSlots(std::size_t n)
+    {
+        const std::size_t owners = mOwners.size() + n;
+        if (owners > mOwners.capacity())
+            mOwners.reserve(std::max(owners, 2 * mOwners.capacity()));
+        const std::size_t slots = mSlots.size() + (n > mFreeSlots.size() ? n - mFreeSlots.size() : 0);
+        if (slots > mSlots.capacity())
+            mSlots.reserve(std::max(slots, 2 * mSlots.capacity()));
+    }
+
+    template<typename T>
+    template<typename ...PARAM>
+    void PackedArray<T>::constructN(T* values, std::size_t n, const PARAM&... param)
+    {
+        std::size_t i = 0;
+        try
+        {
+            for (; i < n; ++i)
+                ::new (values + i) T(param...);
+        }
+        catch (...)
+        {
+            while (i > 0)
+                values[--i].~T();
+            throw;
+        }
+    }
+
+    template<typename T>
+    void PackedArray<T>::reallocate(std::size_t capacity)
+    {
+        reallocate(capacity, [] (T*) {});
+    }
+
+    template<typename T>
+    template<typename F>
+    void PackedArray<T>::reallocate(std::size_t capacity, F construct)
+    {
+        T* values = static_cast<T*>(mBlockResource->allocate(capacity * sizeof(T), alignof(T)));
+        try
+        {
+            construct(values);
+        }
+        catch (...)
+        {
+            mBlockResource->deallocate(values, capacity * sizeof(T), alignof(T));
+            throw;
+        }
+        for (std::size_t i = 0; i < mSize; ++i)
+        {
+            ::new (values + i) T(std::move(mValues[i]));
+            mValues[i].~T();
+        }
+        if (mValues)
+            mBlockResource->deallocate(mValues, mCapacity * sizeof(T), alignof(T));
+        mValues = values;
+        mCapacity = capacity;
+    }
+
+    template<typename T>
+    template<typename ...PARAM>
+    ChunkedArrayHandle PackedArray<T>::add(PARAM&&... param)
+    {
+        //param may refer to an element of this array, so it is read before the old array is freed
+        //the slot is only taken once the element exists, so a throwing constructor changes nothing
+        reserveSlots(1);
+        if (mSize == mCapacity)
+            reallocate(std::max<std::size_t>(2 * mCapacity, 16), [&] (T* values) { ::new (values + mSize) T(std::forward<PARAM>(param)...); });
+        else
+            ::new (mValues + mSize) T(std::forward<PARAM>(param)...);
+        std::uint32_t slot = newSlot();
+        ++mSize;
+        return ChunkedArrayHandle(static_cast<SubID>(slot >> 16), static_cast<SubID>(slot & 0xFFFF));
+    }
+
+    template<typename T>
+    template<typename ...PARAM>
+    ChunkedArrayRangeVector PackedArray<T>::addN(std::size_t n, const PARAM&... param)
+    {
+        ChunkedArrayRangeVector ranges(ResourceAllocator<ChunkedArrayRange>(mSlots.get_allocator()));
+        //the new elements are built before the old array is freed, param may refer into it,
+        //and before any slot is taken
+        reserveSlots(n);
+        auto construct = [&] (T* values) { constructN(values + mSize, n, param...); };
+        if (mSize + n > mCapacity)
+            reallocate(std::max(mSize + n, 2 * mCapacity), construct);
+        else
+            construct(mValues);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            std::uint32_t slot = newSlot();
+            ++mSize;
+            ChunkedArrayHandle h(static_cast<SubID>(slot >> 16), static_cast<SubID>(slot & 0xFFFF));
+            ChunkedArrayRange* last = ranges.empty() ? nullptr : &ranges.back();
+            if (last && last->block == h.block && std::size_t(last->first) + last->count == h.index
+                     && last->count < std::numeric_limits<SubID>::max())
+                ++last->count;
+            else
+                ranges.emplace_back(h.block, h.index, 1);
+        }
+        return ranges;
+    }
+
+    template<typename T>
+    void PackedArray<T>::destroy(ChunkedArrayHandle h)
+    {
+        std::uint32_t slot = static_cast<std::uint32_t>(slotOf(h));
+        std::uint32_t place = mSlots[slot];
+        std::uint32_t last = static_cast<std::uint32_t>(mSize - 1);
+        mValues[place].~T();
+        if (place != last)
+        {
+            ::new (mValues + place) T(std::move(mValues[last]));
+            mValues[last].~T();
+            mOwners[place] = mOwners[last];
+            mSlots[mOwners[place]] = place;
+        }
+        mOwners.pop_back();
+        mSlots[slot] = DEAD_SLOT;
+        mFreeSlots.push_back(slot);
+        --mSize;
+    }
+
+    template<typename T>
+    void PackedArray<T>::destroyMany(const ChunkedArrayHandle* handles, std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+            destroy(handles[i]);
+    }
+
+    template<typename T>
+    void PackedArray<T>::clear()
+    {
+        if (!std::is_trivially_destructible<T>::value)
+            forEach([] (T& element) { element.~T(); });
+        mSize = 0;
+        mSlots.clear();
+        mOwners.clear();
+        mFreeSlots.clear();
+    }
+
+    template<typename T>
+    std::size_t PackedArray<T>::trim()
+    {
+        if (mSize > 0 || !mValues)
+            return 0;
+        mBlockResource->deallocate(mValues, mCapacity * sizeof(T), alignof(T));
+        mValues = nullptr;
+        mCapacity = 0;
+        return 1;
+    }
+
+    template<typename T>
+    std::size_t PackedArray<T>::compact(HandleRefVector&, std::size_t)
+    {
+        return 0;
+    }
+
+    template<typename T>
+    void PackedArray<T>::reserve(std::size_t n)
+    {
+        if (n > mCapacity)
+            reallocate(n);
+        mOwners.reserve(n);
+    }
+
+    template<typename T>
+    void PackedArray<T>::setBlockResource(MemoryResource* resource)
+    {
+        if (mSize > 0)
+            throw std::logic_error("The block resource of a PackedArray can only be changed while it is empty.");
+        trim();
+        mBlockResource = resource;
+    }
+
+    template<typename T>
+    template<typename F>
+    void PackedArray<T>::forEach(F f)
+    {
+        for (std::size_t i = 0; i < mSize; ++i)
+            f(mValues[i]);
+    }
+
+
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    CINDEX ComponentTraitsBase<CINDEX, COMP_TOTAL>::newID()
+    {
+        static CINDEX idCounter = 0;
+        if (idCounter < COMP_TOTAL)
+        {
+            return idCounter++;
+        }
+        else
+        {
+            throw(ComponentCountError());
+        }
+    }
+
+    template<typename C, typename CINDEX, CINDEX COMP_TOTAL>
+    CINDEX ComponentTraits<C, CINDEX, COMP_TOTAL>::getID()
+    {
+        const static CINDEX id = ComponentTraitsBase<CINDEX, COMP_TOTAL>::newID();
+        return id;
+    }
+
+    inline ComponentCountError::ComponentCountError() :
+        std::runtime_error("Attempt to create more than the maximum number of components.") {}
+
+
+
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    EntityHandle<CINDEX, COMP_TOTAL>::EntityHandle(Universe<CINDEX, COMP_TOTAL>* cUniverse,
+                                                   EntityArrayHandle cHandle,
+                                                   unsigned short cGeneration)
+        : mHandle(cHandle), mGeneration(cGeneration), mUniverse(cUniverse) {}
+
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    EntityHandle<CINDEX, COMP_TOTAL>::EntityHandle()
+        : mHandle(EntityArrayHandle::null()), mGeneration(0), mUniverse(nullptr) {}
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    bool EntityHandle<CINDEX, COMP_TOTAL>::valid() const
+    {
+        return mUniverse && mUniverse->valid(*this);
+    }
+
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    void EntityHandle<CINDEX, COMP_TOTAL>::destroy() const
+    {
+        return mUniverse->destroyEntity(*this);
+    }
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename C>
+    bool EntityHandle<CINDEX, COMP_TOTAL>::has() const
+    {
+        return mUniverse->template hasComponent<C>(*this);
+    }
+
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename ... C>
+    void EntityHandle<CINDEX, COMP_TOTAL>::add() const
+    {
+        mUniverse->template addComponent<C...>(*this, ComponentInstantiator<C>(*mUniverse)...);
+    }
+
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename ... C>
+    void EntityHandle<CINDEX, COMP_TOTAL>::add(ComponentInstantiator<C>... ci) const
+    {
+        mUniverse->template addComponent<C...>(*this, ci...);
+    }
+
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename C>
+    typename ComponentStorage<C>::const_reference EntityHandle<CINDEX, COMP_TOTAL>::get() const
+    {
+        return mUniverse->template getComponent<C>(*this);
+    }
+
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename C>
+    typename ComponentStorage<C>::reference EntityHandle<CINDEX, COMP_TOTAL>::modify() const
+    {
+        return mUniverse->template modifyComponent<C>(*this);
+    }
+
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename C>
+    void EntityHandle<CINDEX, COMP_TOTAL>::rem() const
+    {
+        mUniverse->template removeComponent<C>(*this);
+    }
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename ... C>
+    EntityHandle<CINDEX, COMP_TOTAL> EntityHandle<CINDEX, COMP_TOTAL>::copy() const
+    {
+        return mUniverse->template copyEntity<C...>(*this);
+    }
+
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename ... C>
+    EntityHandle<CINDEX, COMP_TOTAL> EntityHandle<CINDEX, COMP_TOTAL>::checkedCopy() const
+    {
+        return mUniverse->template checkedCopyEntity<C...>(*this);
+    }
+
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    EntityID EntityHandle<CINDEX, COMP_TOTAL>::getID() const
+    {
+        return mUniverse->getID(*this);
+    }
+
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    EntityHandle<CINDEX, COMP_TOTAL> EntityHandle<CINDEX, COMP_TOTAL>::nullEntity()
+    {
+        return EntityHandle<CINDEX, COMP_TOTAL>(nullptr, {0,0}, 0);
+    }
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename C, typename ... PARAM>
+    ComponentInstantiator<C> EntityHandle<CINDEX, COMP_TOTAL>::instantiate(PARAM&&... param)
+    {
+        return mUniverse->template instantiate<C>( std::forward<PARAM>(param)... );
+    }
+
+
+
+
+    template<std::size_t BITS>
+    bool Signature<BITS>::contains(const Signature& other) const
+    {
+        for (std::size_t i = 0; i < WORDS; ++i)
+            if ((mWords[i] & other.mWords[i]) != other.mWords[i])
+                return false;
+        return true;
+    }
+
+    template<std::size_t BITS>
+    std::size_t Signature<BITS>::rank(std::size_t i) const
+    {
+        const std::size_t w = i / WORD_BITS;
+        std::size_t r = popcount(mWords[w] & ((uint64_t(1) << (i % WORD_BITS)) - 1));
+        for (std::size_t k = 0; k < w; ++k)
+            r += popcount(mWords[k]);
+        return r;
+    }
+
+    template<std::size_t BITS>
+    std::size_t Signature<BITS>::count() const
+    {
+        std::size_t n = 0;
+        for (std::size_t i = 0; i < WORDS; ++i)
+            n += popcount(mWords[i]);
+        return n;
+    }
+
+    template<std::size_t BITS>
+    template<typename F>
+    void Signature<BITS>::forEachSet(F f) const
+    {
+        for (std::size_t w = 0; w < WORDS; ++w)
+        {
+            for (uint64_t word = mWords[w]; word != 0; word &= word - 1)
+                f(w * WORD_BITS + countTrailingZeros(word));
+        }
+    }
+
+    template<std::size_t BITS>
+    Signature<BITS>& Signature<BITS>::operator|=(const Signature& other)
+    {
+        for (std::size_t i = 0; i < WORDS; ++i)
+            mWords[i] |= other.mWords[i];
+        return *this;
+    }
+
+    template<std::size_t BITS>
+    std::size_t Signature<BITS>::hash() const
+    {
+        uint64_t h = 0;
+        for (std::size_t i = 0; i < WORDS; ++i)
+            h = (h ^ mWords[i]) * 0x9E3779B97F4A7C15ull;
+        //the multiplies only carry bits upwards, mix the high bits back into the low ones (fmix64)
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ull;
+        h ^= h >> 33;
+        return static_cast<std::size_t>(h);
+    }
+
+    template<std::size_t BITS, typename VALUE>
+    SignatureMap<BITS, VALUE>::SignatureMap(MemoryResource* resource)
+        : mResource(resource), mEntries(nullptr), mCapacity(0), mSize(0) {}
+
+    template<std::size_t BITS, typename VALUE>
+    SignatureMap<BITS, VALUE>::~SignatureMap()
+    {
+        clear();
+        if (mEntries)
+            mResource->deallocate(mEntries, mCapacity * sizeof(Entry), alignof(Entry));
+    }
+
+    template<std::size_t BITS, typename VALUE>
+    typename SignatureMap<BITS, VALUE>::Entry* SignatureMap<BITS, VALUE>::probe(const Signature<BITS>& key, std::size_t hash) const
+    {
+        std::size_t i = hash & (mCapacity - 1);
+        while (mEntries[i].hash != 0 && (mEntries[i].hash != hash || mEntries[i].key != key))
+            i = (i + 1) & (mCapacity - 1);
+        return mEntries + i;
+    }
+
+    template<std::size_t BITS, typename VALUE>
+    VALUE* SignatureMap<BITS, VALUE>::find(const Signature<BITS>& key)
+    {
+        if (mSize == 0)
+            return nullptr;
+        Entry* entry = probe(key, hashOf(key));
+        return entry->hash != 0 ? &entry->value : nullptr;
+    }
+
+    template<std::size_t BITS, typename VALUE>
+    VALUE* SignatureMap<BITS, VALUE>::insert(const Signature<BITS>& key, VALUE value)
+    {
+        if (2 * (mSize + 1) > mCapacity)
+            rehash(std::max<std::size_t>(2 * mCapacity, 16));
+        std::size_t hash = hashOf(key);
+        Entry* entry = probe(key, hash);
+        entry->hash = hash;
+        ::new (&entry->key) Signature<BITS>(key);
+        ::new (&entry->value) VALUE(std::move(value));
+        ++mSize;
+        return &entry->value;
+    }
+
+    template<std::size_t BITS, typename VALUE>
+    void SignatureMap<BITS, VALUE>::erase(const Signature<BITS>& key)
+    {
+        if (mSize == 0)
+            return;
+        Entry* entry = probe(key, hashOf(key));
+        if (entry->hash == 0)
+            return;
+        entry->value.~VALUE();
+        --mSize;
+
+        //move back every following entry whose home slot lies at or before the hole
+        std::size_t hole = entry - mEntries;
+        std::size_t i = hole;
+        while (true)
+        {
+            i = (i + 1) & (mCapacity - 1);
+            Entry& next = mEntries[i];
+            if (next.hash == 0)
+                break;
+            std::size_t home = next.hash & (mCapacity - 1);
+            if (((i - home) & (mCapacity - 1)) >= ((i - hole) & (mCapacity - 1)))
+            {
+                mEntries[hole].hash = next.hash;
+                mEntries[hole].key = next.key;
+                ::new (&mEntries[hole].value) VALUE(std::move(next.value));
+                next.value.~VALUE();
+                hole = i;
+            }
+        }
+        mEntries[hole].hash = 0;
+    }
+
+    template<std::size_t BITS, typename VALUE>
+    void SignatureMap<BITS, VALUE>::clear()
+    {
+        for (std::size_t i = 0; i < mCapacity; ++i)
+        {
+            if (mEntries[i].hash != 0)
+            {
+                mEntries[i].value.~VALUE();
+                mEntries[i].hash = 0;
+            }
+        }
+        mSize = 0;
+    }
+
+    template<std::size_t BITS, typename VALUE>
+    void SignatureMap<BITS, VALUE>::rehash(std::size_t capacity)
+    {
+        Entry* old = mEntries;
+        std::size_t oldCapacity = mCapacity;
+        mEntries = static_cast<Entry*>(mResource->allocate(capacity * sizeof(Entry), alignof(Entry)));
+        mCapacity = capacity;
+        for (std::size_t i = 0; i < capacity; ++i)
+            mEntries[i].hash = 0;
+        for (std::size_t i = 0; i < oldCapacity; ++i)
+        {
+            if (old[i].hash != 0)
+            {
+                Entry* entry = probe(old[i].key, old[i].hash);
+                entry->hash = old[i].hash;
+                ::new (&entry->key) Signature<BITS>(old[i].key);
+                ::new (&entry->value) VALUE(std::move(old[i].value));
+                old[i].value.~VALUE();
+            }
+        }
+        if (old)
+            mResource->deallocate(old, oldCapacity * sizeof(Entry), alignof(Entry));
+    }
+
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    MetaData<CINDEX, COMP_TOTAL>::MetaData(Signature<COMP_TOTAL> initialMask, MemoryResource* resource)
+        : mComponentMask(initialMask), mSharedCount(0), mEdges(resource) {}
+
+
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    Universe<CINDEX, COMP_TOTAL>::Universe(MemoryResource* resource)
+        : mResource(resource), mDestroyFunctions(), mEntityData(resource), mGenerations(resource), mComponentMetadata(resource),
+          mEmptyMeta(Signature<COMP_TOTAL>(), resource) {}
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    bool Universe<CINDEX, COMP_TOTAL>::valid( const EntityHandle<CINDEX, COMP_TOTAL>& e ) const
+    {
+        return mGenerations[ e.mHandle.block*ENTITY_BLOCK_SIZE + e.mHandle.index ] == e.mGeneration;
+    }
+
+
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    EntityHandle<CINDEX, COMP_TOTAL> Universe<CINDEX, COMP_TOTAL>::create()
+    {
+        EntityArrayHandle e = mEntityData.add(mResource);
+        mEntityData.get(e).mMetaData = &mEmptyMeta;
+        accommodateEntity(e);
+        return EntityHandle<CINDEX, COMP_TOTAL>(this, e, mGenerations[ e.block*ENTITY_BLOCK_SIZE + e.index ]);
+    }
+
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename ... C>
+    EntityHandle<CINDEX, COMP_TOTAL> Universe<CINDEX, COMP_TOTAL>::create()
+    {
+        return create<C...>(ComponentInstantiator<C>(*this)...);
+    }
+
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename ... C>
+    EntityHandle<CINDEX, COMP_TOTAL> Universe<CINDEX, COMP_TOTAL>::create(ComponentInstantiator<C>... ci)
+    {
+        auto e = create(); //create empty entity
+        e.template add<C...>(ci...);
+        return e;
+    }
+
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename ... C>
+    void Universe<CINDEX, COMP_TOTAL>::create(std::size_t n,
+                                              std::function<void(EntityHandle<CINDEX, COMP_TOTAL> e)> f)
+    {
+        if (n > 0)
+        {
+            std::size_t num = sizeof...(C);  //get the number of components
+
+            //setup a sample mask for the components
+            Signature<COMP_TOTAL> sampleMask;
+            ComponentUnpacker<C...>::prepare(sampleMask);
+
+            //the first entity creates the metadata, all others share it
+            EntityArrayHandle ehandle = mEntityData.add(mResource);
+            connect(mEntityData.get(ehandle), sampleMask);
+            MetaData<CINDEX, COMP_TOTAL>* meta = mEntityData.get(ehandle).mMetaData;
+            meta->mSharedCount += n - 1;
+
+            //create the components in one batch per pool
+            ChunkedArrayRangeVector components{ ResourceAllocator<ChunkedArrayRange>(mResource) };
+            std::array<BatchCursor, sizeof...(C)> cursors;
+            ComponentUnpacker<C...>::addN(*this, n, meta->mComponentMask, components, cursors.data());
+            std::sort(cursors.begin(), cursors.end(), [] (const BatchCursor& a, const BatchCursor& b) { return a.position < b.position; });
+
+            //and hand them to the entities
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                if (i > 0)
+                    ehandle = mEntityData.add(mResource);
+                accommodateEntity(ehandle);
+                EntityData<CINDEX, COMP_TOTAL>& data = mEntityData.get(ehandle);
+                data.mMetaData = meta;
+                data.mComponentHandles.reserve(num);
+                for (auto& cursor : cursors) //in the order of the positions
+                {
+                    data.mComponentHandles.push_back(components[cursor.range].handle(cursor.offset));
+                    if (++cursor.offset == components[cursor.range].count)
+                    {
+                        ++cursor.range;
+                        cursor.offset = 0;
+                    }
+                }
+                f(EntityHandle<CINDEX, COMP_TOTAL>(this, ehandle, mGenerations[ ehandle.block*ENTITY_BLOCK_SIZE + ehandle.index ]));
+            }
+        }
+    }
+
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    void Universe<CINDEX, COMP_TOTAL>::destroyEntity( const EntityHandle<CINDEX, COMP_TOTAL>& e )
+    {
+        if (!valid(e)) return;
+        EntityData<CINDEX, COMP_TOTAL>& data = mEntityData.get(e.mHandle);
+        std::size_t slot = 0; //the handles are sorted like the set bits
+        data.mMetaData->mComponentMask.forEachSet([this, &data, &slot] (std::size_t i) //remove all components
+        {
+            mDestroyFunctions[ i ](*mManagers[ i ], &data.mComponentHandles[slot++], 1);
+        });
+        mEntityData.destroy(e.mHandle);
+        mGenerations[ e.mHandle.block*ENTITY_BLOCK_SIZE + e.mHandle.index ] ++; //invalidates all handles pointing to the deleted entity
+    }
+
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    void Universe<CINDEX, COMP_TOTAL>::clear()
+    {
+        //components with destructors first, a MultiComponent may still destroy elements of a trivial pool
+        for (auto it = mEntityData.begin(); it != mEntityData.end(); ++it)
+        {
+            const EntityData<CINDEX, COMP_TOTAL>& data = *it;
+            std::size_t slot = 0;
+            data.mMetaData->mComponentMask.forEachSet([this, &data, &slot] (std::size_t i)
+            {
+                if (!mTrivialPools.test(i))
+                    mDestroyFunctions[ i ](*mManagers[ i ], &data.mComponentHandles[slot], 1);
+                ++slot;
+            });
+            mGenerations[ it.handle().block*ENTITY_BLOCK_SIZE + it.handle().index ] ++;
+        }
+        for(CINDEX i = 0; i < COMP_TOTAL; ++i)
+        {
+            if (mManagers[ i ] && mTrivialPools.test(i))
+                mManagers[ i ]->clear();
+        }
+        mEntityData.clear();
+        mComponentMetadata.clear(); //no entity refers to any metadata anymore
+        mEmptyMeta.mEdges.clear();
+        mEmptyMeta.mSharedCount = 0;
+    }
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename ITERATOR>
+    void Universe<CINDEX, COMP_TOTAL>::destroy(ITERATOR first, ITERATOR last)
+    {
+        //collect the entities and count them per metadata, a wave of bullets shares one
+        //the generation is increased right away, so a duplicate is not valid anymore
+        struct Group
+        {
+            const MetaData<CINDEX, COMP_TOTAL>* meta;
+            std::size_t count;
+        };
+        std::vector< EntityArrayHandle, ResourceAllocator<EntityArrayHandle> > doomed{ ResourceAllocator<EntityArrayHandle>(mResource) };
+        std::vector< Group, ResourceAllocator<Group> > groups{ ResourceAllocator<Group>(mResource) };
+        for (; first != last; ++first)
+        {
+            const EntityHandle<CINDEX, COMP_TOTAL>& e = *first;
+            if (!valid(e)) continue;
+            doomed.push_back(e.mHandle);
+            mGenerations[ e.mHandle.block*ENTITY_BLOCK_SIZE + e.mHandle.index ] ++;
+            const MetaData<CINDEX, COMP_TOTAL>* meta = mEntityData.get(e.mHandle).mMetaData;
+            if (groups.empty() || groups.back().meta != meta)
+            {
+                auto group = std::find_if(groups.begin(), groups.end(), [meta] (const Group& g) { return g.meta == meta; });
+                if (group == groups.end())
+                    groups.push_back(Group{ meta, 0 });
+                else
+                    std::swap(*group, groups.back()); //the next entity likely shares it
+            }
+            ++groups.back().count;
+        }
+
+        //count the components per pool, once per metadata
+        std::array<std::size_t, COMP_TOTAL + 1> offsets;
+        offsets.fill(0);
+        Signature<COMP_TOTAL> pools;
+        for (const Group& group : groups)
+        {
+            group.meta->mComponentMask.forEachSet([&offsets, &group] (std::size_t i) { offsets[i + 1] += group.count; });
+            pools |= group.meta->mComponentMask;
+        }
 
+        //bucket the component handles by pool
+        for(CINDEX i = 0; i < COMP_TOTAL; ++i)
+            offsets[i + 1] += offsets[i];
+        ComponentHandleVector handles(offsets[COMP_TOTAL], ComponentHandle(), ResourceAllocator<ComponentHandle>(mResource));
+        std::array<std::size_t, COMP_TOTAL> cursors;
+        std::copy(offsets.begin(), offsets.end() - 1, cursors.begin());
+        for (auto ehandle : doomed)
+        {
+            const EntityData<CINDEX, COMP_TOTAL>& data = mEntityData.get(ehandle);
+            std::size_t slot = 0;
+            data.mMetaData->mComponentMask.forEachSet([&handles, &cursors, &data, &slot] (std::size_t i)
+            {
+                handles[ cursors[i]++ ] = data.mComponentHandles[slot++];
+            });
+        }
+
+        //one call per pool
+        pools.forEachSet([this, &handles, &offsets] (std::size_t i)
+        {
+            mDestroyFunctions[ i ](*mManagers[ i ], handles.data() + offsets[i], offsets[i + 1] - offsets[i]);
+        });
+        for (auto ehandle : doomed)
+            mEntityData.destroy(ehandle);
+    }
+
+
+    //helper function
     template<typename CINDEX, CINDEX COMP_TOTAL>
-    void EntityHandle<CINDEX, COMP_TOTAL>::destroy() const
+    template<typename C>
+    ComponentInstantiator<C> Universe<CINDEX, COMP_TOTAL>::instantiateCopy(const EntityHandle<CINDEX, COMP_TOTAL>& e)
     {
-        return mUniverse->destroyEntity(*this);
+        return ComponentInstantiator<C>(*this, getComponent<C>(e));
+    }
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename ... C>
+    EntityHandle<CINDEX, COMP_TOTAL> Universe<CINDEX, COMP_TOTAL>::copyEntity( const EntityHandle<CINDEX, COMP_TOTAL>& e )
+    {
+        EntityArrayHandle ehandle = mEntityData.add(mResource);
+        accommodateEntity(ehandle);
+        EntityData<CINDEX, COMP_TOTAL>& data = mEntityData.get(ehandle);
+
+        //quick connect, just copy pointer
+        data.mMetaData = mEntityData.get(e.mHandle).mMetaData;
+        data.mMetaData->mSharedCount++;
+
+        //as above
+        data.mComponentHandles.reserve(sizeof...(C));
+        ComponentUnpacker<C...>::unpack(data.mComponentHandles, data.mMetaData->mComponentMask, instantiateCopy<C>(e)...);
+
+        return EntityHandle<CINDEX, COMP_TOTAL>(this, ehandle, mGenerations[ ehandle.block*ENTITY_BLOCK_SIZE + ehandle.index ]);
+    }
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename ... C>
+    EntityHandle<CINDEX, COMP_TOTAL> Universe<CINDEX, COMP_TOTAL>::checkedCopyEntity( const EntityHandle<CINDEX, COMP_TOTAL>& e )
+    {
+        EntityArrayHandle ehandle = mEntityData.add(mResource);
+        accommodateEntity(ehandle);
+        EntityData<CINDEX, COMP_TOTAL>& data = mEntityData.get(ehandle);
+
+        //quick connect, just copy pointer
+        data.mMetaData = mEntityData.get(e.mHandle).mMetaData;
+        data.mMetaData->mSharedCount++;
+
+        //as above
+        data.mComponentHandles.reserve(mEntityData.get(e.mHandle).mComponentHandles.size());
+        ComponentUnpacker<C...>::checkedUnpack(*this, e, data.mComponentHandles, data.mMetaData->mComponentMask);
+
+        return EntityHandle<CINDEX, COMP_TOTAL>(this, ehandle, mGenerations[ ehandle.block*ENTITY_BLOCK_SIZE + ehandle.index ]);
     }
 
     template<typename CINDEX, CINDEX COMP_TOTAL>
     template<typename C>
-    bool EntityHandle<CINDEX, COMP_TOTAL>::has() const
+    bool Universe<CINDEX, COMP_TOTAL>::hasComponent( const EntityHandle<CINDEX, COMP_TOTAL>& e ) const
     {
-        return mUniverse->template hasComponent<C>(*this);
+        return mEntityData.get(e.mHandle).mMetaData->mComponentMask.test(ComponentTraits<C, CINDEX, COMP_TOTAL>::getID());
     }
 
 
     template<typename CINDEX, CINDEX COMP_TOTAL>
     template<typename ... C>
-    void EntityHandle<CINDEX, COMP_TOTAL>::add() const
+    void Universe<CINDEX, COMP_TOTAL>::addComponent(const EntityHandle<CINDEX, COMP_TOTAL>& e, ComponentInstantiator<C>... ci)
     {
-        mUniverse->template addComponent<C...>(*this, ComponentInstantiator<C>(*mUniverse)...);
+        EntityData<CINDEX, COMP_TOTAL>& data = mEntityData.get(e.mHandle);
+        MetaData<CINDEX, COMP_TOTAL>* source = data.mMetaData;
+        Signature<COMP_TOTAL> oldmask = source->mComponentMask;
+        const CINDEX ids[sizeof...(C) + 1] = { ComponentTraits<C, CINDEX, COMP_TOTAL>::getID()... };
+        MetaData<CINDEX, COMP_TOTAL>* target;
+        if (sizeof...(C) == 1) //a single component follows the cached edge
+        {
+            target = oldmask.test(ids[0]) ? source : transition(*source, ids[0]);
+        }
+        else
+        {
+            Signature<COMP_TOTAL> mask = oldmask;
+            ComponentUnpacker<C...>::prepare(mask);
+            target = findMetaData(mask);
+        }
+        if (target != source)
+        {
+            disconnect(data);
+            connect(data, target);
+        }
+        ComponentUnpacker<C...>::unpack(*this, data.mComponentHandles, oldmask, data.mMetaData->mComponentMask, ci...);
     }
 
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename C>
+    typename ComponentStorage<C>::reference Universe<CINDEX, COMP_TOTAL>::modifyComponent( const EntityHandle<CINDEX, COMP_TOTAL>& e )
+    {
+        const EntityData<CINDEX, COMP_TOTAL>& data = mEntityData.get(e.mHandle);
+        auto handleIndex = data.mMetaData->mComponentMask.rank(ComponentTraits<C, CINDEX, COMP_TOTAL>::getID());
+        return modifyComponent<C>(data.mComponentHandles[handleIndex]);
+    }
 
     template<typename CINDEX, CINDEX COMP_TOTAL>
-    template<typename ... C>
-    void EntityHandle<CINDEX, COMP_TOTAL>::add(ComponentInstantiator<C>... ci) const
+    template<typename C>
+    typename ComponentStorage<C>::reference Universe<CINDEX, COMP_TOTAL>::modifyComponent( ComponentHandle c )
     {
-        mUniverse->template addComponent<C...>(*this, ci...);
+        ComponentPool<C>* ca = static_cast<ComponentPool<C>*>
+                                                        ( mManagers[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ].get() );
+        return ca->get(c);
     }
 
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename C>
+    typename ComponentStorage<C>::const_reference Universe<CINDEX, COMP_TOTAL>::getComponent( const EntityHandle<CINDEX, COMP_TOTAL>& e ) const
+    {
+        const EntityData<CINDEX, COMP_TOTAL>& data = mEntityData.get(e.mHandle);
+        auto handleIndex = data.mMetaData->mComponentMask.rank(ComponentTraits<C, CINDEX, COMP_TOTAL>::getID());
+        return getComponent<C>(data.mComponentHandles[handleIndex]);
+    }
 
     template<typename CINDEX, CINDEX COMP_TOTAL>
     template<typename C>
-    const C& EntityHandle<CINDEX, COMP_TOTAL>::get() const
+    typename ComponentStorage<C>::const_reference Universe<CINDEX, COMP_TOTAL>::getComponent( ComponentHandle c ) const
     {
-        return mUniverse->template getComponent<C>(*this);
+        const ComponentPool<C>* ca = static_cast<const ComponentPool<C>*>
+                                                        ( mManagers[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ].get() );
+        return ca->get(c);
     }
 
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename C>
+    void Universe<CINDEX, COMP_TOTAL>::getMany(const EntityHandle<CINDEX, COMP_TOTAL>* entities, std::size_t count, C** out)
+    {
+        static_assert(std::is_same<typename ComponentPool<C>::reference, C&>::value,
+                      "Components stored as SoA or hot/cold split have no single address, use gatherMany.");
+        lookupMany<C>(entities, count, [out] (std::size_t i, const C& c) { out[i] = const_cast<C*>(&c); });
+    }
 
     template<typename CINDEX, CINDEX COMP_TOTAL>
     template<typename C>
-    C& EntityHandle<CINDEX, COMP_TOTAL>::modify() const
+    void Universe<CINDEX, COMP_TOTAL>::gatherMany(const EntityHandle<CINDEX, COMP_TOTAL>* entities, std::size_t count, C* out) const
     {
-        return mUniverse->template modifyComponent<C>(*this);
+        lookupMany<C>(entities, count, [out] (std::size_t i, const C& c) { out[i] = c; });
     }
 
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename C, typename F>
+    void Universe<CINDEX, COMP_TOTAL>::lookupMany(const EntityHandle<CINDEX, COMP_TOTAL>* entities, std::size_t count, F f) const
+    {
+        if (count == 0)
+            return;
+        const CINDEX id = ComponentTraits<C, CINDEX, COMP_TOTAL>::getID();
+        const ComponentPool<C>& pool = *static_cast<const ComponentPool<C>*>( mManagers[id].get() );
+        auto handleOf = [this, entities, id] (std::size_t i) -> ComponentHandle
+        {
+            const EntityData<CINDEX, COMP_TOTAL>& data = mEntityData.get(entities[i].mHandle);
+            return data.mComponentHandles[ data.mMetaData->mComponentMask.rank(id) ];
+        };
+
+        //every stage works PREFETCH_DISTANCE entities ahead of the next one and only touches memory
+        //that the previous stage has prefetched: entity record -> handle list -> component
+        const std::size_t d = PREFETCH_DISTANCE;
+        for (std::size_t i = 0; i < count && i < 2*d; ++i)
+            mEntityData.prefetch(entities[i].mHandle);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            if (i + 2*d < count)
+                mEntityData.prefetch(entities[i + 2*d].mHandle);
+            if (i + d < count)
+            {
+                const EntityData<CINDEX, COMP_TOTAL>& data = mEntityData.get(entities[i + d].mHandle);
+                dom::prefetch(&data.mMetaData->mComponentMask);
+                dom::prefetch(data.mComponentHandles.data());
+            }
+            if (i + d/2 < count)
+                pool.prefetch(handleOf(i + d/2));
+            f(i, pool.get(handleOf(i)));
+        }
+    }
 
     template<typename CINDEX, CINDEX COMP_TOTAL>
     template<typename C>
-    void EntityHandle<CINDEX, COMP_TOTAL>::rem() const
+    void Universe<CINDEX, COMP_TOTAL>::removeComponent( const EntityHandle<CINDEX, COMP_TOTAL>& e )
     {
-        mUniverse->template removeComponent<C>(*this);
+        if (hasComponent<C>(e))
+        {
+            EntityData<CINDEX, COMP_TOTAL>& data = mEntityData.get(e.mHandle);
+            auto handleIndex = data.mMetaData->mComponentMask.rank(ComponentTraits<C, CINDEX, COMP_TOTAL>::getID());
+            getManager<C>().destroy( data.mComponentHandles[handleIndex] );
+            data.mComponentHandles.erase( data.mComponentHandles.begin() + handleIndex );
+
+            MetaData<CINDEX, COMP_TOTAL>* target = transition(*data.mMetaData, ComponentTraits<C, CINDEX, COMP_TOTAL>::getID());
+            disconnect(data);
+            connect(data, target);
+        }
     }
 
+
     template<typename CINDEX, CINDEX COMP_TOTAL>
-    template<typename ... C>
-    EntityHandle<CINDEX, COMP_TOTAL> EntityHandle<CINDEX, COMP_TOTAL>::copy() const
+    EntityID Universe<CINDEX, COMP_TOTAL>::getID( const EntityHandle<CINDEX, COMP_TOTAL>& e )
     {
-        return mUniverse->template copyEntity<C...>(*this);
+        EntityID id;
+        id = e.mGeneration;
+        id = (id << sizeof(SubID)) | e.mHandle.index;
+        id = (id << sizeof(SubID)) | e.mHandle.block;
+        return id;
     }
 
 
     template<typename CINDEX, CINDEX COMP_TOTAL>
-    template<typename ... C>
-    EntityHandle<CINDEX, COMP_TOTAL> EntityHandle<CINDEX, COMP_TOTAL>::checkedCopy() const
+    void Universe<CINDEX, COMP_TOTAL>::accommodateEntity( const EntityArrayHandle& e )
     {
-        return mUniverse->template checkedCopyEntity<C...>(*this);
+        std::size_t idraw = e.block*ENTITY_BLOCK_SIZE + e.index;
+        if (mGenerations.size() <= idraw)
+            mGenerations.resize(idraw + 1, 0);
     }
 
 
     template<typename CINDEX, CINDEX COMP_TOTAL>
-    EntityID EntityHandle<CINDEX, COMP_TOTAL>::getID() const
+    void Universe<CINDEX, COMP_TOTAL>::connect(EntityData<CINDEX, COMP_TOTAL>& data, Signature<COMP_TOTAL> mask)
     {
-        return mUniverse->getID(*this);
+        connect(data, findMetaData(mask));
     }
 
 
     template<typename CINDEX, CINDEX COMP_TOTAL>
-    EntityHandle<CINDEX, COMP_TOTAL> EntityHandle<CINDEX, COMP_TOTAL>::nullEntity()
+    void Universe<CINDEX, COMP_TOTAL>::connect(EntityData<CINDEX, COMP_TOTAL>& data, MetaData<CINDEX, COMP_TOTAL>* meta)
     {
-        return EntityHandle<CINDEX, COMP_TOTAL>(nullptr, {0,0}, 0);
+        data.mMetaData = meta; //connect to the metadata
+        data.mMetaData->mSharedCount++;
+    }
+
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    MetaData<CINDEX, COMP_TOTAL>* Universe<CINDEX, COMP_TOTAL>::findMetaData(Signature<COMP_TOTAL> mask)
+    {
+        if (mask == mEmptyMeta.mComponentMask)
+            return &mEmptyMeta;
+        auto meta = mComponentMetadata.find(mask); //find metadata, may construct new
+        if (!meta)
+        {
+            void* mem = mResource->allocate(sizeof(MetaData<CINDEX, COMP_TOTAL>), alignof(MetaData<CINDEX, COMP_TOTAL>));
+            meta = mComponentMetadata.insert( mask, ResourcePtr<MetaData<CINDEX, COMP_TOTAL>>(::new (mem) MetaData<CINDEX, COMP_TOTAL>(mask, mResource), {mResource}) );
+        }
+        return meta->get();
+    }
+
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    MetaData<CINDEX, COMP_TOTAL>* Universe<CINDEX, COMP_TOTAL>::transition(MetaData<CINDEX, COMP_TOTAL>& meta, CINDEX id)
+    {
+        for (const auto& edge : meta.mEdges)
+        {
+            if (edge.component == id)
+                return edge.target;
+        }
+        Signature<COMP_TOTAL> mask = meta.mComponentMask;
+        mask.flip(id);
+        MetaData<CINDEX, COMP_TOTAL>* target = findMetaData(mask);
+        meta.mEdges.push_back({ id, target });
+        target->mEdges.push_back({ id, &meta });
+        return target;
+    }
+
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    void Universe<CINDEX, COMP_TOTAL>::disconnect(const EntityData<CINDEX, COMP_TOTAL>& data)
+    {
+        MetaData<CINDEX, COMP_TOTAL>* meta = data.mMetaData;
+        meta->mSharedCount--;
+        if (meta->mSharedCount == 0 && meta != &mEmptyMeta) //no entities with the current bitset anymore, can remove metadata
+        {
+            for (const auto& edge : meta->mEdges) //the neighbours forget their edge back
+            {
+                auto& back = edge.target->mEdges;
+                back.erase(std::find_if(back.begin(), back.end(), [&edge] (const typename MetaData<CINDEX, COMP_TOTAL>::Edge& other)
+                                        { return other.component == edge.component; }));
+            }
+            mComponentMetadata.erase(meta->mComponentMask);
+        }
+    }
+
+
+    template<typename C, typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename ... PARAM>
+    MultiComponent<C, CINDEX, COMP_TOTAL>::MultiComponent(std::size_t num, Universe<CINDEX, COMP_TOTAL>& universe, PARAM&& ... param)
+        : mHandles(ResourceAllocator<ComponentHandle>(universe.mResource)), mUniverse(nullptr)
+    {
+        init(num, universe, std::forward<PARAM>(param) ... );
+    }
+
+
+
+    template<typename C, typename CINDEX, CINDEX COMP_TOTAL>
+    MultiComponent<C, CINDEX, COMP_TOTAL>::MultiComponent() : mUniverse(nullptr) {}
+
+    template<typename C, typename CINDEX, CINDEX COMP_TOTAL>
+    MultiComponent<C, CINDEX, COMP_TOTAL>::MultiComponent(const MultiComponent& other)
+        : mHandles(other.mHandles.get_allocator()), mUniverse(other.mUniverse)
+    {
+        mHandles.reserve(other.mHandles.size());
+        for (std::size_t i = 0; i < other.getComponentCount(); ++i)
+            mHandles.emplace_back( ComponentInstantiator<C>( *mUniverse, other.getComponent(i) ).handle );
+    }
+
+    template<typename C, typename CINDEX, CINDEX COMP_TOTAL>
+    MultiComponent<C, CINDEX, COMP_TOTAL>::MultiComponent(MultiComponent&& other)
+        : mHandles(std::move(other.mHandles)), mUniverse(other.mUniverse)
+    {
+        other.mHandles.clear();
+    }
+
+    template<typename C, typename CINDEX, CINDEX COMP_TOTAL>
+    MultiComponent<C, CINDEX, COMP_TOTAL>& MultiComponent<C, CINDEX, COMP_TOTAL>::operator=(MultiComponent other)
+    {
+        std::swap(mHandles, other.mHandles);
+        std::swap(mUniverse, other.mUniverse);
+        return *this;
+    }
+
+    template<typename C, typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename ... PARAM>
+    void MultiComponent<C, CINDEX, COMP_TOTAL>::init(std::size_t num, Universe<CINDEX, COMP_TOTAL>& universe, PARAM&& ... param)
+    {
+        mUniverse = &universe;
+        cleanup();
+        if (mHandles.get_allocator().resource() != universe.mResource)
+            mHandles = ComponentHandleVector(ResourceAllocator<ComponentHandle>(universe.mResource));
+        mHandles.reserve(num);
+        for (std::size_t i = 0; i < num; ++i)
+        {
+            auto instantiator = ComponentInstantiator<C>( universe, std::forward<PARAM>(param)... );
+            mHandles.emplace_back(instantiator.handle);
+        }
+    }
+
+    template<typename C, typename CINDEX, CINDEX COMP_TOTAL>
+    typename ComponentStorage<C>::reference MultiComponent<C, CINDEX, COMP_TOTAL>::getComponent(std::size_t index)
+    {
+        return mUniverse->template modifyComponent<C>(mHandles[index]);
+    }
+
+    template<typename C, typename CINDEX, CINDEX COMP_TOTAL>
+    typename ComponentStorage<C>::const_reference MultiComponent<C, CINDEX, COMP_TOTAL>::getComponent(std::size_t index) const
+    {
+        return mUniverse->template getComponent<C>(mHandles[index]);
+    }
+
+    template<typename C, typename CINDEX, CINDEX COMP_TOTAL>
+    std::size_t MultiComponent<C, CINDEX, COMP_TOTAL>::getComponentCount() const
+    {
+        return mHandles.size();
+    }
+
+    template<typename C, typename CINDEX, CINDEX COMP_TOTAL>
+    void MultiComponent<C, CINDEX, COMP_TOTAL>::cleanup()
+    {
+        for (auto h : mHandles)
+        {
+            using Pool = typename Universe<CINDEX, COMP_TOTAL>::template ComponentPool<C>;
+            Pool* ca = static_cast<Pool*>
+                ( mUniverse->mManagers[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ].get() );
+            ca->destroy(h);
+        }
+        mHandles.clear();
+    }
+
+    template<typename C, typename CINDEX, CINDEX COMP_TOTAL>
+    MultiComponent<C, CINDEX, COMP_TOTAL>::~MultiComponent()
+    {
+        cleanup();
     }
 
     template<typename CINDEX, CINDEX COMP_TOTAL>
     template<typename C, typename ... PARAM>
-    ComponentInstantiator<C> EntityHandle<CINDEX, COMP_TOTAL>::instantiate(PARAM&&... param)
+    ComponentInstantiator<C> Universe<CINDEX, COMP_TOTAL>::instantiate(PARAM&&... param)
     {
-        return mUniverse->template instantiate<C>( std::forward<PARAM>(param)... );
+        return ComponentInstantiator<C>( *this, std::forward<PARAM>(param)... );
+    }
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    std::size_t Universe<CINDEX, COMP_TOTAL>::getEntityCount() const
+    {
+        return mEntityData.size();
     }
 
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename C>
+    std::size_t Universe<CINDEX, COMP_TOTAL>::getComponentCount() const
+    {
+        if (mManagers[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ])
+        {
+            ComponentPool<C>* ca = static_cast<ComponentPool<C>*>
+                                                            ( mManagers[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ].get() );
+            return ca->size();
+        }
+        else return 0u;
+    }
 
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename C>
+    void Universe<CINDEX, COMP_TOTAL>::setReusePolicy(ReusePolicy policy)
+    {
+        getManager<C>().setReusePolicy(policy);
+    }
 
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename C>
+    void Universe<CINDEX, COMP_TOTAL>::setBlockResource(MemoryResource* resource)
+    {
+        getManager<C>().setBlockResource(resource);
+    }
 
     template<typename CINDEX, CINDEX COMP_TOTAL>
-    MetaData<CINDEX, COMP_TOTAL>::MetaData(std::bitset< COMP_TOTAL > initialMask) : mComponentMask(initialMask), mSharedCount(0)
+    template<typename C>
+    std::size_t Universe<CINDEX, COMP_TOTAL>::compact(std::size_t budget)
     {
-        CINDEX bitc = 0;
-        for (CINDEX i = 0; i < COMP_TOTAL; ++i)
+        const CINDEX id = ComponentTraits<C, CINDEX, COMP_TOTAL>::getID();
+        if (!mManagers[ id ])
+            return 0u;
+        HandleRefVector refs{ ResourceAllocator<ComponentHandle*>(mResource) };
+        mEntityData.forEach([&refs, id](EntityData<CINDEX, COMP_TOTAL>& data)
         {
-            if (initialMask.test(i))
-                mMetaData[i] = bitc++;
-        }
+            if (data.mMetaData->mComponentMask.test(id))
+                refs.push_back(&data.mComponentHandles[ data.mMetaData->mComponentMask.rank(id) ]);
+        });
+        return mManagers[ id ]->compact(refs, budget);
     }
 
-
-
     template<typename CINDEX, CINDEX COMP_TOTAL>
-    Universe<CINDEX, COMP_TOTAL>::Universe() : mEmptyMeta(std::bitset<COMP_TOTAL>()) {}
-
-    template<typename CINDEX, CINDEX COMP_TOTAL>
-    bool Universe<CINDEX, COMP_TOTAL>::valid( const EntityHandle<CINDEX, COMP_TOTAL>& e ) const
+    std::size_t Universe<CINDEX, COMP_TOTAL>::compactAll(std::size_t budget)
     {
-        return mGenerations[ e.mHandle.block*ENTITY_BLOCK_SIZE + e.mHandle.index ] == e.mGeneration;
+        //a single pass over the entities collects the handles for all pools
+        std::vector< HandleRefVector, ResourceAllocator<HandleRefVector> > refs(COMP_TOTAL, HandleRefVector(ResourceAllocator<ComponentHandle*>(mResource)),
+                                                                           ResourceAllocator<HandleRefVector>(mResource));
+        mEntityData.forEach([&refs](EntityData<CINDEX, COMP_TOTAL>& data)
+        {
+            std::size_t slot = 0;
+            data.mMetaData->mComponentMask.forEachSet([&refs, &data, &slot] (std::size_t i)
+            {
+                refs[i].push_back(&data.mComponentHandles[slot++]);
+            });
+        });
+        std::size_t moved = 0;
+        for (std::size_t i = 0; i < COMP_TOTAL && moved < budget; ++i)
+        {
+            if (mManagers[ i ] && !refs[i].empty())
+                moved += mManagers[ i ]->compact(refs[i], budget - moved);
+        }
+        return moved;
     }
 
-
-
     template<typename CINDEX, CINDEX COMP_TOTAL>
-    EntityHandle<CINDEX, COMP_TOTAL> Universe<CINDEX, COMP_TOTAL>::create()
+    void Universe<CINDEX, COMP_TOTAL>::reserve(std::size_t entities)
     {
-        EntityArrayHandle e = mEntityData.add();
-        mEntityData.get(e).mMetaData = &mEmptyMeta;
-        accommodateEntity(e);
-        return EntityHandle<CINDEX, COMP_TOTAL>(this, e, mGenerations[ e.block*ENTITY_BLOCK_SIZE + e.index ]);
+        mEntityData.reserve(entities);
+        mGenerations.reserve(mEntityData.slotCount()); //every id the reserved blocks can hand out
     }
 
-
     template<typename CINDEX, CINDEX COMP_TOTAL>
-    template<typename ... C>
-    EntityHandle<CINDEX, COMP_TOTAL> Universe<CINDEX, COMP_TOTAL>::create()
+    template<typename C>
+    void Universe<CINDEX, COMP_TOTAL>::reserve(std::size_t n)
     {
-        return create<C...>(ComponentInstantiator<C>(*this)...);
+        getManager<C>().reserve(n);
     }
 
-
     template<typename CINDEX, CINDEX COMP_TOTAL>
-    template<typename ... C>
-    EntityHandle<CINDEX, COMP_TOTAL> Universe<CINDEX, COMP_TOTAL>::create(ComponentInstantiator<C>... ci)
+    std::size_t Universe<CINDEX, COMP_TOTAL>::trim()
     {
-        auto e = create(); //create empty entity
-        e.template add<C...>(ci...);
-        return e;
+        std::size_t released = mEntityData.trim(); //the generation counters stay, so old handles remain invalid
+        for (auto& manager : mManagers)
+        {
+            if (manager)
+                released += manager->trim();
+        }
+        return released;
     }
 
-
     template<typename CINDEX, CINDEX COMP_TOTAL>
-    template<typename ... C>
-    void Universe<CINDEX, COMP_TOTAL>::create(std::size_t n,
-                                              std::function<void(EntityHandle<CINDEX, COMP_TOTAL> e)> f)
+    template<typename C>
+    std::size_t Universe<CINDEX, COMP_TOTAL>::getComponentBlockCount() const
     {
-        if (n > 0)
+        if (mManagers[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ])
         {
-            std::size_t num = sizeof...(C);  //get the number of components
-
-            //accomodate a new entity
-            EntityArrayHandle ehandle = mEntityData.add();
-            accommodateEntity(ehandle);
-            EntityData<CINDEX, COMP_TOTAL>& data = mEntityData.get(ehandle);
-
-            //setup a sample mask for the components
-            std::bitset<COMP_TOTAL> sampleMask;
-            ComponentUnpacker<C...>::prepare(sampleMask);
-            connect(data, sampleMask);
-
-            //create the components and insert them to their correct positions in data.mComponentHandles
-            data.mComponentHandles.reserve(num);
-            ComponentUnpacker<C...>::unpack(data.mComponentHandles, data.mMetaData->mMetaData, ComponentInstantiator<C>(*this)...);
-
-            EntityHandle<CINDEX, COMP_TOTAL> esample = EntityHandle<CINDEX, COMP_TOTAL>(this, ehandle, mGenerations[ ehandle.block*ENTITY_BLOCK_SIZE + ehandle.index ]);
-
-            //invoke the callback for the first entity
-            f(esample);
-
-            for(std::size_t i = 1; i < n; ++i)
-            {
-                //invoke the callback all other entities
-                f(copyEntity<C...>(esample));
-            }
+            ComponentPool<C>* ca = static_cast<ComponentPool<C>*>
+                                                            ( mManagers[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ].get() );
+            return ca->blockCount();
         }
+        else return 0u;
     }
 
-
     template<typename CINDEX, CINDEX COMP_TOTAL>
-    void Universe<CINDEX, COMP_TOTAL>::destroyEntity( const EntityHandle<CINDEX, COMP_TOTAL>& e )
+    template<typename C>
+    typename Universe<CINDEX, COMP_TOTAL>::template ComponentPool<C>& Universe<CINDEX, COMP_TOTAL>::getManager()
     {
-        if (!valid(e)) return;
-        EntityData<CINDEX, COMP_TOTAL>& data = mEntityData.get(e.mHandle);
-        for(CINDEX i = 0; i < COMP_TOTAL; ++i) //remove all components
+        //create the corresponding container if not existing yet
+        if (!mManagers[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ])
         {
-            if (data.mMetaData->mComponentMask.test(i))
-            {
-                auto handleIndex = data.mComponentHandles[data.mMetaData->mMetaData[ i ]];
-                mManagers[ i ].get()->destroy(handleIndex);
-            }
+            void* mem = mResource->allocate(sizeof(ComponentPool<C>), alignof(ComponentPool<C>));
+            mManagers[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ] = std::unique_ptr<BaseChunkedArray, PoolDeleter>(
+                ::new (mem) ComponentPool<C>(mResource), PoolDeleter{ mResource, sizeof(ComponentPool<C>), alignof(ComponentPool<C>) } );
+            mDestroyFunctions[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ] = &destroyComponents<C>;
+            mTrivialPools.set( ComponentTraits<C, CINDEX, COMP_TOTAL>::getID(), std::is_trivially_destructible<C>::value );
         }
-        mEntityData.destroy(e.mHandle);
-        mGenerations[ e.mHandle.block*ENTITY_BLOCK_SIZE + e.mHandle.index ] ++; //invalidates all handles pointing to the deleted entity
+        return *static_cast<ComponentPool<C>*>( mManagers[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ].get() );
     }
 
-
-    //helper function
     template<typename CINDEX, CINDEX COMP_TOTAL>
     template<typename C>
-    ComponentInstantiator<C> Universe<CINDEX, COMP_TOTAL>::instantiateCopy(const EntityHandle<CINDEX, COMP_TOTAL>& e)
+    void Universe<CINDEX, COMP_TOTAL>::destroyComponents(BaseChunkedArray& pool, const ComponentHandle* handles, std::size_t count)
     {
-        return ComponentInstantiator<C>(*this, getComponent<C>(e));
+        static_cast<ComponentPool<C>&>(pool).destroyMany(handles, count);
     }
 
     template<typename CINDEX, CINDEX COMP_TOTAL>
-    template<typename ... C>
-    EntityHandle<CINDEX, COMP_TOTAL> Universe<CINDEX, COMP_TOTAL>::copyEntity( const EntityHandle<CINDEX, COMP_TOTAL>& e )
+    template<typename C, typename F>
+    void Universe<CINDEX, COMP_TOTAL>::forEach(F f)
     {
-        EntityArrayHandle ehandle = mEntityData.add();
-        accommodateEntity(ehandle);
-        EntityData<CINDEX, COMP_TOTAL>& data = mEntityData.get(ehandle);
+        if (mManagers[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ])
+        {
+            ComponentPool<C>* ca = static_cast<ComponentPool<C>*>
+                                                            ( mManagers[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ].get() );
+            ca->forEach(f);
+        }
+    }
 
-        //quick connect, just copy pointer
-        data.mMetaData = mEntityData.get(e.mHandle).mMetaData;
-        data.mMetaData->mSharedCount++;
 
-        //as above
-        data.mComponentHandles.reserve(sizeof...(C));
-        ComponentUnpacker<C...>::unpack(data.mComponentHandles, data.mMetaData->mMetaData, instantiateCopy<C>(e)...);
 
-        return EntityHandle<CINDEX, COMP_TOTAL>(this, ehandle, mGenerations[ ehandle.block*ENTITY_BLOCK_SIZE + ehandle.index ]);
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename C, typename F>
+    void Universe<CINDEX, COMP_TOTAL>::forEachBlock(F f)
+    {
+        if (mManagers[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ])
+        {
+            ComponentPool<C>* ca = static_cast<ComponentPool<C>*>
+                                                            ( mManagers[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ].get() );
+            ca->forEachBlock(f);
+        }
     }
 
     template<typename CINDEX, CINDEX COMP_TOTAL>
-    template<typename ... C>
-    EntityHandle<CINDEX, COMP_TOTAL> Universe<CINDEX, COMP_TOTAL>::checkedCopyEntity( const EntityHandle<CINDEX, COMP_TOTAL>& e )
+    template<typename C, typename F>
+    void Universe<CINDEX, COMP_TOTAL>::forEachHot(F f)
     {
-        EntityArrayHandle ehandle = mEntityData.add();
-        accommodateEntity(ehandle);
-        EntityData<CINDEX, COMP_TOTAL>& data = mEntityData.get(ehandle);
-
-        //quick connect, just copy pointer
-        data.mMetaData = mEntityData.get(e.mHandle).mMetaData;
-        data.mMetaData->mSharedCount++;
+        if (mManagers[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ])
+        {
+            ComponentPool<C>* ca = static_cast<ComponentPool<C>*>
+                                                            ( mManagers[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ].get() );
+            ca->forEachHot(f);
+        }
+    }
 
-        //as above
-        data.mComponentHandles.reserve(mEntityData.get(e.mHandle).mComponentHandles.size());
-        ComponentUnpacker<C...>::checkedUnpack(*this, e, data.mComponentHandles, data.mMetaData->mMetaData);
 
-        return EntityHandle<CINDEX, COMP_TOTAL>(this, ehandle, mGenerations[ ehandle.block*ENTITY_BLOCK_SIZE + ehandle.index ]);
-    }
 
-    template<typename CINDEX, CINDEX COMP_TOTAL>
     template<typename C>
-    bool Universe<CINDEX, COMP_TOTAL>::hasComponent( const EntityHandle<CINDEX, COMP_TOTAL>& e ) const
+    template<typename CINDEX, CINDEX COMP_TOTAL, typename ... PARAM>
+    ComponentInstantiator<C>::ComponentInstantiator(Universe<CINDEX, COMP_TOTAL>& universe, PARAM&& ... param)
     {
-        return mEntityData.get(e.mHandle).mMetaData->mComponentMask.test(ComponentTraits<C, CINDEX, COMP_TOTAL>::getID());
+        handle = universe.template getManager<C>().add( std::forward<PARAM>(param)... );
     }
 
 
+    template<typename C>
     template<typename CINDEX, CINDEX COMP_TOTAL>
-    template<typename ... C>
-    void Universe<CINDEX, COMP_TOTAL>::addComponent(const EntityHandle<CINDEX, COMP_TOTAL>& e, ComponentInstantiator<C>... ci)
+    void ComponentInstantiator<C>::clear(Universe<CINDEX, COMP_TOTAL>& universe)
     {
-        EntityData<CINDEX, COMP_TOTAL>& data = mEntityData.get(e.mHandle);
-        std::bitset<COMP_TOTAL> mask = data.mMetaData->mComponentMask;
-        std::bitset<COMP_TOTAL> oldmask = data.mMetaData->mComponentMask;
-        ComponentUnpacker<C...>::prepare(mask);
-        disconnect(data);
-        connect(data, mask);
-        ComponentUnpacker<C...>::unpack(*this, data.mComponentHandles, oldmask, data.mMetaData->mMetaData, ci...);
+        using Pool = typename Universe<CINDEX, COMP_TOTAL>::template ComponentPool<C>;
+        Pool* ca = static_cast<Pool*>( universe.mManagers[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ].get() );
+        ca->destroy(handle);
     }
 
+
     template<typename CINDEX, CINDEX COMP_TOTAL>
-    template<typename C>
-    C& Universe<CINDEX, COMP_TOTAL>::modifyComponent( const EntityHandle<CINDEX, COMP_TOTAL>& e )
+    ArchetypeUniverse<CINDEX, COMP_TOTAL>::ArchetypeUniverse(MemoryResource* resource)
+        : mResource(resource), mTypes(), mArchetypes(resource), mArchetypeMap(resource), mRecords(resource),
+          mGenerations(resource), mFreeEntities(resource) {}
+
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    ArchetypeUniverse<CINDEX, COMP_TOTAL>::~ArchetypeUniverse()
     {
-        return const_cast<C&>( static_cast<const Universe<CINDEX, COMP_TOTAL>*>(this)->getComponent<C>(e) );
+        clear();
     }
 
     template<typename CINDEX, CINDEX COMP_TOTAL>
     template<typename C>
-    C& Universe<CINDEX, COMP_TOTAL>::modifyComponent( ComponentHandle c )
+    void ArchetypeUniverse<CINDEX, COMP_TOTAL>::relocateComponent(void* to, void* from)
     {
-        return const_cast<C&>( static_cast<const Universe<CINDEX, COMP_TOTAL>*>(this)->getComponent<C>(c) );
+        C* source = static_cast<C*>(from);
+        ::new (to) C(std::move(*source));
+        source->~C();
     }
 
     template<typename CINDEX, CINDEX COMP_TOTAL>
     template<typename C>
-    const C& Universe<CINDEX, COMP_TOTAL>::getComponent( const EntityHandle<CINDEX, COMP_TOTAL>& e ) const
+    void ArchetypeUniverse<CINDEX, COMP_TOTAL>::destroyComponent(void* p)
     {
-        const EntityData<CINDEX, COMP_TOTAL>& data = mEntityData.get(e.mHandle);
-        auto handleIndex = data.mMetaData->mMetaData[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ];
-        return getComponent<C>(data.mComponentHandles[handleIndex]);
+        static_cast<C*>(p)->~C();
     }
 
     template<typename CINDEX, CINDEX COMP_TOTAL>
     template<typename C>
-    const C& Universe<CINDEX, COMP_TOTAL>::getComponent( ComponentHandle c ) const
+    CINDEX ArchetypeUniverse<CINDEX, COMP_TOTAL>::registerType()
     {
-        ChunkedArray<C, COMPONENT_BLOCK_SIZE>* ca = static_cast<ChunkedArray<C, COMPONENT_BLOCK_SIZE>*>
-                                                        ( mManagers[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ].get() );
-        return ca->get(c);
+        CINDEX id = ComponentTraits<C, CINDEX, COMP_TOTAL>::getID();
+        if (mTypes[id].size == 0)
+            mTypes[id] = ColumnType{ sizeof(C), alignof(C), &relocateComponent<C>, &destroyComponent<C> };
+        return id;
     }
 
     template<typename CINDEX, CINDEX COMP_TOTAL>
-    template<typename C>
-    void Universe<CINDEX, COMP_TOTAL>::removeComponent( const EntityHandle<CINDEX, COMP_TOTAL>& e )
+    typename ArchetypeUniverse<CINDEX, COMP_TOTAL>::Archetype& ArchetypeUniverse<CINDEX, COMP_TOTAL>::getArchetype(Signature<COMP_TOTAL> mask)
     {
-        if (hasComponent<C>(e))
+        auto found = mArchetypeMap.find(mask);
+        if (found)
+            return **found;
+
+        void* mem = mResource->allocate(sizeof(Archetype), alignof(Archetype));
+        mArchetypes.emplace_back( ::new (mem) Archetype(mask, mResource), ResourceDeleter<Archetype>{mResource} );
+        Archetype& archetype = *mArchetypes.back();
+        std::size_t rowBytes = sizeof(std::uint32_t);
+        for (std::size_t i = 0; i < COMP_TOTAL; ++i)
         {
-            EntityData<CINDEX, COMP_TOTAL>& data = mEntityData.get(e.mHandle);
-            auto handleIndex = data.mMetaData->mMetaData[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ];
-            mManagers[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ].get()->destroy( data.mComponentHandles[handleIndex] );
-            data.mComponentHandles.erase( data.mComponentHandles.begin() + handleIndex );
+            if (mask.test(i))
+            {
+                archetype.columns[i] = static_cast<CINDEX>(archetype.components.size());
+                archetype.components.push_back(static_cast<CINDEX>(i));
+                archetype.offsets.push_back(0);
+                rowBytes += mTypes[i].size;
+                archetype.chunkAlignment = std::max(archetype.chunkAlignment, mTypes[i].alignment);
+            }
+        }
 
-            std::bitset<COMP_TOTAL> mask = data.mMetaData->mComponentMask;
-            mask.set(ComponentTraits<C, CINDEX, COMP_TOTAL>::getID(), false); //set the bit
-            disconnect(data);
-            connect(data, mask);
+        //as many rows as fit into a chunk, with each column aligned for its type
+        archetype.capacity = std::max<std::size_t>(CHUNK_BYTES / rowBytes, 1);
+        while (true)
+        {
+            std::size_t bytes = archetype.capacity * sizeof(std::uint32_t);
+            for (std::size_t c = 0; c < archetype.components.size(); ++c)
+            {
+                const ColumnType& type = mTypes[archetype.components[c]];
+                bytes = (bytes + type.alignment - 1) / type.alignment * type.alignment;
+                archetype.offsets[c] = bytes;
+                bytes += archetype.capacity * type.size;
+            }
+            archetype.chunkBytes = bytes;
+            if (bytes <= CHUNK_BYTES || archetype.capacity == 1)
+                break;
+            --archetype.capacity;
         }
+        mArchetypeMap.insert(mask, &archetype);
+        return archetype;
     }
 
-
     template<typename CINDEX, CINDEX COMP_TOTAL>
-    EntityID Universe<CINDEX, COMP_TOTAL>::getID( const EntityHandle<CINDEX, COMP_TOTAL>& e )
+    typename ArchetypeUniverse<CINDEX, COMP_TOTAL>::EntityRecord ArchetypeUniverse<CINDEX, COMP_TOTAL>::allocateRow(Archetype& archetype, std::uint32_t entity)
     {
-        EntityID id;
-        id = e.mGeneration;
-        id = (id << sizeof(SubID)) | e.mHandle.index;
-        id = (id << sizeof(SubID)) | e.mHandle.block;
-        return id;
+        if (archetype.chunks.empty() || archetype.chunks.back().count == archetype.capacity)
+        {
+            void* data = mResource->allocate(archetype.chunkBytes, archetype.chunkAlignment);
+            archetype.chunks.push_back(Chunk{ static_cast<unsigned char*>(data), 0 });
+        }
+        Chunk& chunk = archetype.chunks.back();
+        std::uint32_t row = static_cast<std::uint32_t>(chunk.count++);
+        reinterpret_cast<std::uint32_t*>(chunk.data)[row] = entity;
+        ++archetype.size;
+        return EntityRecord{ &archetype, static_cast<std::uint32_t>(archetype.chunks.size() - 1), row };
     }
 
-
     template<typename CINDEX, CINDEX COMP_TOTAL>
-    void Universe<CINDEX, COMP_TOTAL>::accommodateEntity( const EntityArrayHandle& e )
+    void ArchetypeUniverse<CINDEX, COMP_TOTAL>::vacateRow(Archetype& archetype, std::uint32_t chunk, std::uint32_t row)
     {
-        std::size_t idraw = e.block*ENTITY_BLOCK_SIZE + e.index;
-        if (mGenerations.size() <= idraw)
-            mGenerations.emplace_back(0);
+        std::uint32_t lastChunk = static_cast<std::uint32_t>(archetype.chunks.size() - 1);
+        Chunk& last = archetype.chunks.back();
+        std::uint32_t lastRow = static_cast<std::uint32_t>(last.count - 1);
+        if (chunk != lastChunk || row != lastRow)
+        {
+            for (std::size_t c = 0; c < archetype.components.size(); ++c)
+                mTypes[archetype.components[c]].relocate(cell(archetype, chunk, c, row), cell(archetype, lastChunk, c, lastRow));
+            std::uint32_t moved = reinterpret_cast<std::uint32_t*>(last.data)[lastRow];
+            reinterpret_cast<std::uint32_t*>(archetype.chunks[chunk].data)[row] = moved;
+            mRecords[moved].chunk = chunk;
+            mRecords[moved].row = row;
+        }
+        --archetype.size;
+        if (--last.count == 0)
+        {
+            mResource->deallocate(last.data, archetype.chunkBytes, archetype.chunkAlignment);
+            archetype.chunks.pop_back();
+        }
     }
 
-
     template<typename CINDEX, CINDEX COMP_TOTAL>
-    void Universe<CINDEX, COMP_TOTAL>::connect(EntityData<CINDEX, COMP_TOTAL>& data, std::bitset<COMP_TOTAL> mask)
+    void* ArchetypeUniverse<CINDEX, COMP_TOTAL>::cell(const Archetype& archetype, std::uint32_t chunk, std::size_t column, std::uint32_t row) const
     {
-        auto hashval = mask.to_ullong(); //get the hash value for the current bitset
-        auto meta = mComponentMetadata.emplace( hashval, std::unique_ptr<MetaData<CINDEX, COMP_TOTAL>>() ); //find metadata, may construct new
-        if (meta.second)
-            meta.first->second.reset( new MetaData<CINDEX, COMP_TOTAL>(mask) );
-        data.mMetaData = meta.first->second.get(); //connect to the metadata
-        data.mMetaData->mSharedCount++;
+        return archetype.chunks[chunk].data + archetype.offsets[column] + row * mTypes[archetype.components[column]].size;
     }
 
-
     template<typename CINDEX, CINDEX COMP_TOTAL>
-    void Universe<CINDEX, COMP_TOTAL>::disconnect(const EntityData<CINDEX, COMP_TOTAL>& data)
+    template<typename C>
+    C* ArchetypeUniverse<CINDEX, COMP_TOTAL>::column(const Archetype& archetype, const Chunk& chunk)
     {
-        data.mMetaData->mSharedCount--;
-        if (data.mMetaData->mSharedCount == 0) //no entities with the current bitset anymore, can remove metadata
-        {
-            auto hashval = data.mMetaData->mComponentMask.to_ullong();
-            mComponentMetadata.erase(hashval);
-        }
+        std::size_t c = archetype.columns[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ];
+        return reinterpret_cast<C*>(chunk.data + archetype.offsets[c]);
     }
 
-
-    template<typename C, typename CINDEX, CINDEX COMP_TOTAL>
-    template<typename ... PARAM>
-    MultiComponent<C, CINDEX, COMP_TOTAL>::MultiComponent(std::size_t num, Universe<CINDEX, COMP_TOTAL>& universe, PARAM&& ... param)
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    ArchetypeEntity ArchetypeUniverse<CINDEX, COMP_TOTAL>::create()
     {
-        init(num, universe, std::forward<PARAM>(param) ... );
+        return createEntity<>();
     }
 
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename ... C>
+    ArchetypeEntity ArchetypeUniverse<CINDEX, COMP_TOTAL>::create()
+    {
+        return createEntity<C...>(C()...);
+    }
 
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename ... C>
+    ArchetypeEntity ArchetypeUniverse<CINDEX, COMP_TOTAL>::create(C... components)
+    {
+        return createEntity<C...>(std::move(components)...);
+    }
 
-    template<typename C, typename CINDEX, CINDEX COMP_TOTAL>
-    MultiComponent<C, CINDEX, COMP_TOTAL>::MultiComponent() : mUniverse(nullptr) {}
-
-    template<typename C, typename CINDEX, CINDEX COMP_TOTAL>
-    template<typename ... PARAM>
-    void MultiComponent<C, CINDEX, COMP_TOTAL>::init(std::size_t num, Universe<CINDEX, COMP_TOTAL>& universe, PARAM&& ... param)
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename ... C, typename ... ARG>
+    ArchetypeEntity ArchetypeUniverse<CINDEX, COMP_TOTAL>::createEntity(ARG&&... components)
     {
-        mUniverse = &universe;
-        cleanup();
-        mHandles.reserve(num);
-        for (std::size_t i = 0; i < num; ++i)
+        Signature<COMP_TOTAL> mask;
+        int expand[] = { 0, (mask.set(registerType<C>()), 0)... };
+        (void)expand;
+        Archetype& archetype = getArchetype(mask);
+
+        std::uint32_t index;
+        if (mFreeEntities.empty())
         {
-            auto instantiator = ComponentInstantiator<C>( universe, std::forward<PARAM>(param)... );
-            mHandles.emplace_back(instantiator.handle);
+            index = static_cast<std::uint32_t>(mRecords.size());
+            mRecords.push_back(EntityRecord{ nullptr, 0, 0 });
+            mGenerations.push_back(0);
+        }
+        else
+        {
+            index = mFreeEntities.back();
+            mFreeEntities.pop_back();
         }
+        EntityRecord record = allocateRow(archetype, index);
+        int construct[] = { 0, (::new (cell(archetype, record.chunk, archetype.columns[ComponentTraits<C, CINDEX, COMP_TOTAL>::getID()], record.row))
+                                    C(std::forward<ARG>(components)), 0)... };
+        (void)construct;
+        mRecords[index] = record;
+        return ArchetypeEntity{ index, mGenerations[index] };
     }
 
-    template<typename C, typename CINDEX, CINDEX COMP_TOTAL>
-    C& MultiComponent<C, CINDEX, COMP_TOTAL>::getComponent(std::size_t index)
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    void ArchetypeUniverse<CINDEX, COMP_TOTAL>::destroy(ArchetypeEntity e)
     {
-        return mUniverse->template modifyComponent<C>(mHandles[index]);
+        if (!valid(e))
+            return;
+        EntityRecord record = mRecords[e.index];
+        Archetype& archetype = *record.archetype;
+        for (std::size_t c = 0; c < archetype.components.size(); ++c)
+            mTypes[archetype.components[c]].destroy(cell(archetype, record.chunk, c, record.row));
+        vacateRow(archetype, record.chunk, record.row);
+        mRecords[e.index].archetype = nullptr;
+        mGenerations[e.index]++; //invalidates all handles pointing to the deleted entity
+        mFreeEntities.push_back(e.index);
     }
 
-    template<typename C, typename CINDEX, CINDEX COMP_TOTAL>
-    const C& MultiComponent<C, CINDEX, COMP_TOTAL>::getComponent(std::size_t index) const
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    void ArchetypeUniverse<CINDEX, COMP_TOTAL>::clear()
     {
-        return mUniverse->template getComponent<C>(mHandles[index]);
+        for (auto& archetype : mArchetypes)
+        {
+            for (std::uint32_t k = 0; k < archetype->chunks.size(); ++k)
+            {
+                for (std::size_t c = 0; c < archetype->components.size(); ++c)
+                    for (std::uint32_t row = 0; row < archetype->chunks[k].count; ++row)
+                        mTypes[archetype->components[c]].destroy(cell(*archetype, k, c, row));
+                mResource->deallocate(archetype->chunks[k].data, archetype->chunkBytes, archetype->chunkAlignment);
+            }
+            archetype->chunks.clear();
+            archetype->size = 0;
+        }
+        for (std::uint32_t i = 0; i < mRecords.size(); ++i)
+        {
+            if (mRecords[i].archetype)
+            {
+                mRecords[i].archetype = nullptr;
+                mGenerations[i]++;
+                mFreeEntities.push_back(i);
+            }
+        }
     }
 
-    template<typename C, typename CINDEX, CINDEX COMP_TOTAL>
-    std::size_t MultiComponent<C, CINDEX, COMP_TOTAL>::getComponentCount() const
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    bool ArchetypeUniverse<CINDEX, COMP_TOTAL>::valid(ArchetypeEntity e) const
     {
-        return mHandles.size();
+        return e.index < mGenerations.size() && mGenerations[e.index] == e.generation && mRecords[e.index].archetype;
     }
 
-    template<typename C, typename CINDEX, CINDEX COMP_TOTAL>
-    void MultiComponent<C, CINDEX, COMP_TOTAL>::cleanup()
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename C>
+    bool ArchetypeUniverse<CINDEX, COMP_TOTAL>::has(ArchetypeEntity e) const
     {
-        for (auto h : mHandles)
-        {
-            ChunkedArray<C, Universe<CINDEX, COMP_TOTAL>::COMPONENT_BLOCK_SIZE>* ca =
-                static_cast<ChunkedArray<C, Universe<CINDEX, COMP_TOTAL>::COMPONENT_BLOCK_SIZE>*>
-                ( mUniverse->mManagers[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ].get() );
-            ca->destroy(h);
-        }
-        mHandles.clear();
+        return mRecords[e.index].archetype->mask.test(ComponentTraits<C, CINDEX, COMP_TOTAL>::getID());
     }
 
-    template<typename C, typename CINDEX, CINDEX COMP_TOTAL>
-    MultiComponent<C, CINDEX, COMP_TOTAL>::~MultiComponent()
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename C>
+    C& ArchetypeUniverse<CINDEX, COMP_TOTAL>::get(ArchetypeEntity e)
     {
-        cleanup();
+        const EntityRecord& record = mRecords[e.index];
+        return column<C>(*record.archetype, record.archetype->chunks[record.chunk])[record.row];
     }
 
     template<typename CINDEX, CINDEX COMP_TOTAL>
-    template<typename C, typename ... PARAM>
-    ComponentInstantiator<C> Universe<CINDEX, COMP_TOTAL>::instantiate(PARAM&&... param)
+    template<typename C>
+    const C& ArchetypeUniverse<CINDEX, COMP_TOTAL>::get(ArchetypeEntity e) const
     {
-        return ComponentInstantiator<C>( *this, std::forward<PARAM>(param)... );
+        const EntityRecord& record = mRecords[e.index];
+        return column<C>(*record.archetype, record.archetype->chunks[record.chunk])[record.row];
     }
 
     template<typename CINDEX, CINDEX COMP_TOTAL>
-    std::size_t Universe<CINDEX, COMP_TOTAL>::getEntityCount() const
+    template<typename C, typename ... PARAM>
+    C& ArchetypeUniverse<CINDEX, COMP_TOTAL>::add(ArchetypeEntity e, PARAM&&... param)
     {
-        return mEntityData.size();
+        CINDEX id = registerType<C>();
+        EntityRecord source = mRecords[e.index];
+        if (source.archetype->mask.test(id))
+            return get<C>(e);
+
+        Signature<COMP_TOTAL> mask = source.archetype->mask;
+        mask.set(id);
+        Archetype& target = getArchetype(mask);
+        EntityRecord record = allocateRow(target, e.index);
+        C* component = ::new (cell(target, record.chunk, target.columns[id], record.row)) C(std::forward<PARAM>(param)...);
+        for (std::size_t c = 0; c < source.archetype->components.size(); ++c)
+        {
+            CINDEX other = source.archetype->components[c];
+            mTypes[other].relocate(cell(target, record.chunk, target.columns[other], record.row),
+                                   cell(*source.archetype, source.chunk, c, source.row));
+        }
+        vacateRow(*source.archetype, source.chunk, source.row);
+        mRecords[e.index] = record;
+        return *component;
     }
 
     template<typename CINDEX, CINDEX COMP_TOTAL>
     template<typename C>
-    std::size_t Universe<CINDEX, COMP_TOTAL>::getComponentCount() const
+    void ArchetypeUniverse<CINDEX, COMP_TOTAL>::remove(ArchetypeEntity e)
     {
-        if (mManagers[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ])
+        CINDEX id = ComponentTraits<C, CINDEX, COMP_TOTAL>::getID();
+        EntityRecord source = mRecords[e.index];
+        if (!source.archetype->mask.test(id))
+            return;
+
+        Signature<COMP_TOTAL> mask = source.archetype->mask;
+        mask.reset(id);
+        Archetype& target = getArchetype(mask);
+        EntityRecord record = allocateRow(target, e.index);
+        for (std::size_t c = 0; c < source.archetype->components.size(); ++c)
         {
-            ChunkedArray<C, COMPONENT_BLOCK_SIZE>* ca = static_cast<ChunkedArray<C, COMPONENT_BLOCK_SIZE>*>
-                                                            ( mManagers[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ].get() );
-            return ca->size();
+            CINDEX other = source.archetype->components[c];
+            void* from = cell(*source.archetype, source.chunk, c, source.row);
+            if (other == id)
+                mTypes[other].destroy(from);
+            else
+                mTypes[other].relocate(cell(target, record.chunk, target.columns[other], record.row), from);
         }
-        else return 0u;
+        vacateRow(*source.archetype, source.chunk, source.row);
+        mRecords[e.index] = record;
     }
 
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename F, typename ... C>
+    void ArchetypeUniverse<CINDEX, COMP_TOTAL>::streamChunk(F& f, std::size_t count, C*... columns)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+            f(columns[i]...);
+    }
 
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename ... C, typename F>
+    void ArchetypeUniverse<CINDEX, COMP_TOTAL>::forEach(F f)
+    {
+        forEachChunk<C...>([&f] (std::size_t count, C*... columns) { streamChunk(f, count, columns...); });
+    }
 
-    template<typename C>
-    template<typename CINDEX, CINDEX COMP_TOTAL, typename ... PARAM>
-    ComponentInstantiator<C>::ComponentInstantiator(Universe<CINDEX, COMP_TOTAL>& universe, PARAM&& ... param)
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    template<typename ... C, typename F>
+    void ArchetypeUniverse<CINDEX, COMP_TOTAL>::forEachChunk(F f)
     {
-        //create the corresponding container if not existing yet
-        if (!universe.mManagers[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ])
+        Signature<COMP_TOTAL> query;
+        int expand[] = { 0, (query.set(ComponentTraits<C, CINDEX, COMP_TOTAL>::getID()), 0)... };
+        (void)expand;
+        for (auto& archetype : mArchetypes)
         {
-            universe.mManagers[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ] =
-                std::unique_ptr<BaseChunkedArray>( new ChunkedArray<C, universe.COMPONENT_BLOCK_SIZE>() );
+            if (!archetype->mask.contains(query))
+                continue;
+            for (const Chunk& chunk : archetype->chunks)
+                f(chunk.count, column<C>(*archetype, chunk)...);
         }
-        ChunkedArray<C, universe.COMPONENT_BLOCK_SIZE>* ca =
-                static_cast<ChunkedArray<C, universe.COMPONENT_BLOCK_SIZE>*>( universe.mManagers[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ].get() );
-
-        handle = ca->add( std::forward<PARAM>(param)... );
     }
 
+    template<typename CINDEX, CINDEX COMP_TOTAL>
+    std::size_t ArchetypeUniverse<CINDEX, COMP_TOTAL>::getEntityCount() const
+    {
+        return mRecords.size() - mFreeEntities.size();
+    }
 
-    template<typename C>
     template<typename CINDEX, CINDEX COMP_TOTAL>
-    void ComponentInstantiator<C>::clear(Universe<CINDEX, COMP_TOTAL>& universe)
+    std::size_t ArchetypeUniverse<CINDEX, COMP_TOTAL>::getArchetypeCount() const
     {
-        ChunkedArray<C, universe.COMPONENT_BLOCK_SIZE>* ca =
-                static_cast<ChunkedArray<C, universe.COMPONENT_BLOCK_SIZE>*>( universe.mManagers[ ComponentTraits<C, CINDEX, COMP_TOTAL>::getID() ].get() );
-        ca->destroy(handle);
+        return mArchetypes.size();
     }
 
 
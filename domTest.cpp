@@ -9,6 +9,34 @@
 #include <boost/test/unit_test.hpp>
 #include <iostream>
 #include <chrono>
+#include <cstdlib>
+#include <new>
+
+//counts the allocations that bypass every MemoryResource
+static std::size_t globalAllocations = 0;
+
+//gcc pairs malloc with operator delete once the replacements are inlined
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(std::size_t bytes)
+{
+    ++globalAllocations;
+    if (void* p = std::malloc(bytes > 0 ? bytes : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
 
 
 BOOST_AUTO_TEST_CASE( chunked_array_test )
@@ -61,6 +89,320 @@ BOOST_AUTO_TEST_CASE( chunked_array_test )
     //check for leaks
     BOOST_CHECK_EQUAL(pos.size(), 0u);
 }
+BOOST_AUTO_TEST_CASE( chunked_array_iteration )
+{
+    dom::ChunkedArray<int, 130> arr;
+    std::vector<dom::ChunkedArrayHandle> handles;
+    for (int i = 0; i < 300; ++i)
+        handles.push_back(arr.add(i));
+    for (int i = 0; i < 300; ++i)
+        if (i % 3 != 0 || (i >= 64 && i < 200))
+            arr.destroy(handles[i]);
+
+    //visits live elements in address order
+    std::vector<int> visited;
+    arr.forEach([&visited](int& v) { visited.push_back(v); });
+    std::vector<int> expected;
+    for (int i = 0; i < 300; ++i)
+        if (i % 3 == 0 && (i < 64 || i >= 200))
+            expected.push_back(i);
+    BOOST_CHECK(visited == expected);
+
+    //iterators agree with forEach and hand out valid handles
+    std::size_t n = 0;
+    for (auto it = arr.begin(); it != arr.end(); ++it, ++n)
+    {
+        BOOST_CHECK_EQUAL(*it, expected[n]);
+        BOOST_CHECK(arr.alive(it.handle()));
+        BOOST_CHECK_EQUAL(arr.get(it.handle()), expected[n]);
+    }
+    BOOST_CHECK_EQUAL(n, arr.size());
+
+    for (auto it = arr.begin(); it != arr.end(); ++it)
+        arr.destroy(it.handle());
+    BOOST_CHECK(arr.begin() == arr.end());
+}
+
+BOOST_AUTO_TEST_CASE( chunked_array_free_list )
+{
+    //tiny elements are padded so a dead slot can hold the free list link
+    dom::ChunkedArray<char, 4> small;
+    auto c1 = small.add('a');
+    auto c2 = small.add('b');
+    small.destroy(c1);
+    auto c3 = small.add('c');
+    BOOST_CHECK(c1 == c3);
+    BOOST_CHECK_EQUAL(small.get(c2), 'b');
+    BOOST_CHECK_EQUAL(small.get(c3), 'c');
+
+    //delayed reuse: slots come back in the order they were freed, once more than REUSE_C are free
+    dom::ChunkedArray<int, 4, 2> delayed;
+    std::vector<dom::ChunkedArrayHandle> h;
+    for (int i = 0; i < 4; ++i)
+        h.push_back(delayed.add(i));
+    delayed.destroy(h[2]);
+    delayed.destroy(h[0]);
+    auto fresh = delayed.add(10); //only two slots free, block full -> new block
+    BOOST_CHECK_EQUAL(fresh.block, 1u);
+    delayed.destroy(h[1]);
+    BOOST_CHECK(delayed.add(11) == h[2]);
+    BOOST_CHECK_EQUAL(delayed.blockCount(), 2u);
+    BOOST_CHECK_EQUAL(delayed.size(), 3u);
+
+    //a bulk add into the emptied array keeps the delay as well
+    dom::ChunkedArray<int, 4, 2> bulk;
+    auto stale = bulk.add(0);
+    bulk.destroy(stale);
+    auto ranges = bulk.addN(3, 1);
+    for (const auto& range : ranges)
+        for (std::size_t i = 0; i < range.count; ++i)
+            BOOST_CHECK(range.handle(i) != stale);
+    BOOST_CHECK(!bulk.alive(stale));
+}
+
+BOOST_AUTO_TEST_CASE( chunked_array_reuse_policy )
+{
+    dom::ChunkedArray<int, 4> arr;
+    std::vector<dom::ChunkedArrayHandle> h;
+    for (int i = 0; i < 12; ++i)
+        h.push_back(arr.add(i));
+    //block 0 keeps 3 elements, block 1 keeps 1, block 2 keeps 3
+    arr.destroy(h[2]);
+    arr.destroy(h[4]);
+    arr.destroy(h[5]);
+    arr.destroy(h[6]);
+    arr.destroy(h[9]);
+
+    arr.setReusePolicy(dom::ReusePolicy::LOWEST_BLOCK);
+    BOOST_CHECK(arr.add(0) == h[2]);
+    BOOST_CHECK_EQUAL(arr.add(0).block, 1u);
+    arr.destroy(h[1]);
+    BOOST_CHECK(arr.add(0) == h[1]); //a slot freed in a lower block is preferred again
+
+    arr.setReusePolicy(dom::ReusePolicy::FULLEST_BLOCK);
+    BOOST_CHECK(arr.add(0) == h[9]); //block 2 holds 3 elements, block 1 only 2
+    BOOST_CHECK_EQUAL(arr.add(0).block, 1u);
+    BOOST_CHECK_EQUAL(arr.add(0).block, 1u);
+    BOOST_CHECK_EQUAL(arr.blockCount(), 3u);
+    BOOST_CHECK_EQUAL(arr.size(), 12u);
+    BOOST_CHECK_EQUAL(arr.add(0).block, 3u); //everything is full
+}
+
+BOOST_AUTO_TEST_CASE( chunked_array_trim )
+{
+    dom::ChunkedArray<int, 4> arr;
+    std::vector<dom::ChunkedArrayHandle> h;
+    for (int i = 0; i < 16; ++i)
+        h.push_back(arr.add(i));
+    for (int i = 0; i < 16; ++i)
+        if (i / 4 != 2)
+            arr.destroy(h[i]);
+    BOOST_CHECK_EQUAL(arr.blockCount(), 4u);
+    BOOST_CHECK_EQUAL(arr.trim(), 3u);
+    BOOST_CHECK_EQUAL(arr.blockCount(), 1u);
+    for (int i = 8; i < 12; ++i)
+        BOOST_CHECK_EQUAL(arr.get(h[i]), i);
+
+    //released blocks are refilled before new ones are appended
+    auto a = arr.add(100);
+    BOOST_CHECK_EQUAL(a.block, 0u);
+    for (int i = 0; i < 3; ++i)
+        arr.add(i);
+    BOOST_CHECK_EQUAL(arr.add(0).block, 1u);
+    for (int i = 0; i < 3; ++i)
+        arr.add(i);
+    BOOST_CHECK_EQUAL(arr.add(0).block, 3u);
+    BOOST_CHECK_EQUAL(arr.blockCount(), 4u);
+    BOOST_CHECK_EQUAL(arr.get(a), 100);
+    BOOST_CHECK_EQUAL(arr.size(), 13u);
+
+    //delayed reuse keeps the order in which the remaining slots were freed
+    dom::ChunkedArray<int, 4, 2> delayed;
+    h.clear();
+    for (int i = 0; i < 12; ++i)
+        h.push_back(delayed.add(i));
+    for (int i = 8; i < 12; ++i)
+        delayed.destroy(h[i]);
+    delayed.destroy(h[5]);
+    delayed.destroy(h[1]);
+    delayed.destroy(h[6]);
+    BOOST_CHECK_EQUAL(delayed.trim(), 1u);
+    BOOST_CHECK(delayed.add(0) == h[5]);
+    BOOST_CHECK_EQUAL(delayed.size(), 6u);
+
+    dom::ChunkedArray<int, 4> lowest;
+    lowest.setReusePolicy(dom::ReusePolicy::LOWEST_BLOCK);
+    h.clear();
+    for (int i = 0; i < 12; ++i)
+        h.push_back(lowest.add(i));
+    for (int i = 0; i < 4; ++i)
+        lowest.destroy(h[i]);
+    lowest.destroy(h[9]);
+    BOOST_CHECK_EQUAL(lowest.trim(), 1u);
+    BOOST_CHECK(lowest.add(0) == h[9]);
+}
+
+BOOST_AUTO_TEST_CASE( chunked_array_bulk )
+{
+    dom::ChunkedArray<int, 64> arr;
+    auto ranges = arr.addN(100, 7);
+    BOOST_REQUIRE_EQUAL(ranges.size(), 2u);
+    BOOST_CHECK_EQUAL(ranges[0].block, 0u);
+    BOOST_CHECK_EQUAL(ranges[0].count, 64u);
+    BOOST_CHECK_EQUAL(ranges[1].block, 1u);
+    BOOST_CHECK_EQUAL(ranges[1].count, 36u);
+    BOOST_CHECK_EQUAL(arr.size(), 100u);
+    BOOST_CHECK_EQUAL(arr.get(ranges[1].handle(35)), 7);
+
+    //fresh tail first, then the freed slots, merged into one range
+    arr.destroyN(dom::ChunkedArrayRange(0, 10, 4));
+    BOOST_CHECK(!arr.alive(dom::ChunkedArrayHandle(0, 12)));
+    auto more = arr.addN(32, 1);
+    BOOST_REQUIRE_EQUAL(more.size(), 2u);
+    BOOST_CHECK_EQUAL(more[0].block, 1u);
+    BOOST_CHECK_EQUAL(more[0].first, 36u);
+    BOOST_CHECK_EQUAL(more[0].count, 28u);
+    BOOST_CHECK_EQUAL(more[1].block, 0u);
+    BOOST_CHECK_EQUAL(more[1].first, 10u);
+    BOOST_CHECK_EQUAL(more[1].count, 4u);
+    BOOST_CHECK_EQUAL(arr.get(dom::ChunkedArrayHandle(0, 12)), 1);
+    BOOST_CHECK_EQUAL(arr.blockCount(), 2u);
+
+    int sum = 0;
+    arr.forEach([&sum] (int v) { sum += v; });
+    BOOST_CHECK_EQUAL(sum, 96*7 + 32);
+
+    arr.destroyN(more);
+    BOOST_CHECK_EQUAL(arr.size(), 96u);
+    BOOST_CHECK(arr.alive(dom::ChunkedArrayHandle(0, 9)));
+    BOOST_CHECK(!arr.alive(dom::ChunkedArrayHandle(1, 36)));
+
+    //an emptied array hands out its blocks from the start again, without walking the free slots
+    arr.destroyN(dom::ChunkedArrayRange(0, 0, 10));
+    arr.destroyN(dom::ChunkedArrayRange(0, 14, 50));
+    arr.destroyN(ranges[1]);
+    BOOST_CHECK_EQUAL(arr.size(), 0u);
+    auto again = arr.addN(100, 3);
+    BOOST_REQUIRE_EQUAL(again.size(), 2u);
+    BOOST_CHECK_EQUAL(again[0].first, 0u);
+    BOOST_CHECK_EQUAL(again[0].count, 64u);
+    BOOST_CHECK_EQUAL(arr.blockCount(), 2u);
+    BOOST_CHECK_EQUAL(arr.add(4).block, 1u);
+}
+
+BOOST_AUTO_TEST_CASE( reserve_capacity )
+{
+    dom::ChunkedArray<int, 4> arr;
+    BOOST_CHECK_EQUAL(arr.capacity(), 0u);
+    arr.add(0);
+    arr.reserve(10);
+    BOOST_CHECK_EQUAL(arr.blockCount(), 3u);
+    BOOST_CHECK_EQUAL(arr.capacity(), 12u);
+    std::vector<dom::ChunkedArrayHandle> h;
+    for (int i = 1; i < 12; ++i)
+        h.push_back(arr.add(i));
+    BOOST_CHECK_EQUAL(arr.blockCount(), 3u);
+    BOOST_CHECK_EQUAL(h.back().block, 2u);
+    BOOST_CHECK_EQUAL(arr.get(h.back()), 11);
+
+    //unused reserved blocks are given back by trim
+    arr.reserve(20);
+    BOOST_CHECK_EQUAL(arr.blockCount(), 5u);
+    BOOST_CHECK_EQUAL(arr.trim(), 2u);
+    BOOST_CHECK_EQUAL(arr.capacity(), 12u);
+
+    //slots held back for delayed reuse are not capacity
+    dom::ChunkedArray<int, 4, 2> delayed;
+    h.clear();
+    for (int i = 0; i < 4; ++i)
+        h.push_back(delayed.add(i));
+    delayed.destroy(h[0]);
+    delayed.destroy(h[1]);
+    BOOST_CHECK_EQUAL(delayed.capacity(), 2u);
+    delayed.reserve(4);
+    BOOST_CHECK_EQUAL(delayed.blockCount(), 2u);
+    delayed.add(4);
+    delayed.add(5);
+    BOOST_CHECK_EQUAL(delayed.blockCount(), 2u);
+
+    //block ids end where a SubID ends, no handle may alias an earlier one
+    dom::ChunkedArray<int, 1> tiny;
+    auto first = tiny.add(0);
+    dom::ChunkedArrayHandle last;
+    for (int i = 1; i <= std::numeric_limits<SubID>::max(); ++i)
+        last = tiny.add(i);
+    BOOST_CHECK_EQUAL(last.block, std::numeric_limits<SubID>::max());
+    BOOST_CHECK_THROW(tiny.add(0), std::length_error);
+    BOOST_CHECK_THROW(tiny.reserve(tiny.size() + 1), std::length_error);
+    BOOST_CHECK_EQUAL(tiny.get(first), 0);
+    BOOST_CHECK_EQUAL(tiny.get(last), std::numeric_limits<SubID>::max());
+
+    struct Position
+    {
+        Position() : x(0), y(0) {}
+
+        float x;
+        float y;
+    };
+
+    dom::Universe<> universe;
+    universe.reserve(20000);
+    universe.reserve<Position>(20000);
+    BOOST_CHECK_EQUAL(universe.getComponentBlockCount<Position>(), 3u);
+    std::vector<dom::EntityHandle<>> entities;
+    universe.create<Position>(20000, [&entities] (dom::EntityHandle<> e) { entities.push_back(e); });
+    BOOST_CHECK_EQUAL(universe.getComponentBlockCount<Position>(), 3u);
+    BOOST_CHECK_EQUAL(universe.getEntityCount(), 20000u);
+    BOOST_CHECK(entities.back().valid());
+    for (auto& e : entities)
+        e.destroy();
+}
+
+BOOST_AUTO_TEST_CASE( flat_chunked_array )
+{
+    dom::ChunkedArray<int, 1024, 0, alignof(int), 4> arr;
+    std::vector<dom::ChunkedArrayHandle> h;
+    for (int i = 0; i < 3000; ++i)
+        h.push_back(arr.add(i));
+    BOOST_CHECK_EQUAL(arr.blockCount(), 3u);
+    for (int i = 0; i < 3000; ++i)
+        BOOST_REQUIRE_EQUAL(arr.get(h[i]), i);
+    BOOST_CHECK_EQUAL(&arr.get(h[1]) - &arr.get(h[0]), 1);
+
+    //a trimmed block is committed again at the same address
+    int* second = &arr.get(h[1024]);
+    for (int i = 1024; i < 2048; ++i)
+        arr.destroy(h[i]);
+    BOOST_CHECK_EQUAL(arr.trim(), 1u);
+    auto again = arr.addN(1024, 5);
+    BOOST_REQUIRE_EQUAL(again.size(), 2u);
+    BOOST_CHECK_EQUAL(again.back().block, 1u);
+    BOOST_CHECK_EQUAL(&arr.get(again.back().handle(0)), second);
+    BOOST_CHECK_EQUAL(*second, 5);
+
+    //the reservation is the hard limit
+    arr.addN(4*1024 - arr.size(), 1);
+    BOOST_CHECK_EQUAL(arr.blockCount(), 4u);
+    BOOST_CHECK_THROW(arr.add(0), std::bad_alloc);
+
+    //failed adds and reserves leave the array as it was
+    dom::ChunkedArray<int, 4, 0, alignof(int), 2> small;
+    h.clear();
+    for (int i = 0; i < 8; ++i)
+        h.push_back(small.add(i));
+    for (int i = 0; i < 3; ++i)
+        BOOST_CHECK_THROW(small.add(0), std::bad_alloc);
+    BOOST_CHECK_THROW(small.reserve(12), std::bad_alloc);
+    BOOST_CHECK_EQUAL(small.blockCount(), 2u);
+    for (auto handle : h)
+        small.destroy(handle);
+    BOOST_CHECK_EQUAL(small.trim(), 2u);
+    BOOST_CHECK_EQUAL(small.blockCount(), 0u);
+    for (int i = 0; i < 8; ++i)
+        BOOST_CHECK_EQUAL(small.get(small.add(i)), i);
+    BOOST_CHECK_EQUAL(small.blockCount(), 2u);
+}
+
 BOOST_AUTO_TEST_CASE( component_id_test )
 {
     struct Position
@@ -97,6 +439,142 @@ BOOST_AUTO_TEST_CASE( component_id_test )
     BOOST_REQUIRE(check);
 }
 
+template<int N>
+struct Tag
+{
+    int value = N;
+};
+
+/** \brief Registers Tag<0>, ..., Tag<N> in this order, so Tag<N> gets the id N. */
+template<int N>
+struct TagRegistry
+{
+    static void registerAll()
+    {
+        TagRegistry<N - 1>::registerAll();
+        dom::ComponentTraits<Tag<N>, unsigned short, 128>::getID();
+    }
+};
+
+template<>
+struct TagRegistry<0>
+{
+    static void registerAll() { dom::ComponentTraits<Tag<0>, unsigned short, 128>::getID(); }
+};
+
+BOOST_AUTO_TEST_CASE( wide_signatures )
+{
+    TagRegistry<100>::registerAll();
+    BOOST_CHECK_EQUAL((dom::ComponentTraits<Tag<100>, unsigned short, 128>::getID()), 100);
+
+    //component ids beyond the first 64 bit word
+    dom::Universe<unsigned short, 128> universe;
+    auto high = universe.create<Tag<100>, Tag<1>>();
+    auto low = universe.create<Tag<1>>();
+    BOOST_CHECK(high.has<Tag<100>>());
+    BOOST_CHECK(!low.has<Tag<100>>());
+    BOOST_CHECK_EQUAL(high.get<Tag<100>>().value, 100);
+    high.add<Tag<64>>();
+    high.rem<Tag<100>>();
+    BOOST_CHECK(high.has<Tag<64>>());
+    BOOST_CHECK_EQUAL(high.get<Tag<1>>().value, 1);
+    high.rem<Tag<64>>(); //same signature as low now
+    low.destroy();
+    BOOST_CHECK_EQUAL(high.get<Tag<1>>().value, 1);
+    universe.clear();
+
+    //the handle of a component sits at the rank of its bit
+    dom::Signature<128> signature;
+    signature.set(3).set(63).set(64).set(100);
+    BOOST_CHECK_EQUAL(signature.rank(3), 0u);
+    BOOST_CHECK_EQUAL(signature.rank(64), 2u);
+    BOOST_CHECK_EQUAL(signature.rank(100), 3u);
+    BOOST_CHECK_EQUAL(signature.count(), 4u);
+    BOOST_CHECK(!signature.flip(64).test(64));
+    BOOST_CHECK(signature.flip(64).test(64));
+
+    //the open addressing map keeps every key reachable while others are erased
+    dom::SignatureMap<128, int> map;
+    std::vector<dom::Signature<128>> keys;
+    for (int i = 0; i < 200; ++i)
+    {
+        dom::Signature<128> key;
+        key.set(i % 128).set(127 - i / 2);
+        if (map.find(key))
+            continue;
+        keys.push_back(key);
+        map.insert(key, i);
+    }
+    BOOST_CHECK_EQUAL(map.size(), keys.size());
+    for (std::size_t i = 0; i < keys.size(); i += 2)
+        map.erase(keys[i]);
+    for (std::size_t i = 0; i < keys.size(); ++i)
+        BOOST_CHECK_EQUAL(map.find(keys[i]) != nullptr, i % 2 == 1);
+    BOOST_CHECK_EQUAL(map.size(), keys.size() / 2);
+
+    //masks that differ only in high ids of a word still spread over the table
+    for (std::size_t base : {44, 108})
+    {
+        dom::SignatureMap<128, int> highMap;
+        std::vector<bool> homes(2048, false);
+        std::size_t distinct = 0;
+        for (int i = 0; i < 1000; ++i)
+        {
+            const std::size_t bits = std::size_t(i + 1) | (std::size_t(i * 7 % 1024) << 10);
+            dom::Signature<128> key;
+            for (std::size_t bit = 0; bit < 20; ++bit)
+                key.set(base + bit, (bits >> bit) & 1);
+            highMap.insert(key, i);
+            const std::size_t home = key.hash() & 2047;
+            distinct += homes[home] ? 0 : 1;
+            homes[home] = true;
+        }
+        BOOST_CHECK_GT(distinct, 500u);
+        BOOST_CHECK_EQUAL(highMap.size(), 1000u);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( set_bit_destroy )
+{
+    //set bits are visited in ascending order across words
+    dom::Signature<128> signature;
+    signature.set(100).set(0).set(64).set(63);
+    std::vector<std::size_t> bits;
+    signature.forEachSet([&bits] (std::size_t i) { bits.push_back(i); });
+    BOOST_CHECK((bits == std::vector<std::size_t>{0, 63, 64, 100}));
+
+    //interleaved signatures are grouped, every survivor keeps its own components
+    TagRegistry<100>::registerAll();
+    dom::Universe<unsigned short, 128> universe;
+    std::vector<dom::EntityHandle<unsigned short, 128>> doomed, kept;
+    for (int i = 0; i < 300; ++i)
+    {
+        auto e = i % 3 == 0 ? universe.create<Tag<1>, Tag<100>>() : i % 3 == 1 ? universe.create<Tag<64>>() : universe.create<Tag<0>, Tag<64>, Tag<100>>();
+        if (i % 3 != 0) e.modify<Tag<64>>().value = i;
+        (i % 2 == 0 ? doomed : kept).push_back(e);
+    }
+    universe.destroy(doomed.begin(), doomed.end());
+    BOOST_CHECK_EQUAL(universe.getEntityCount(), 150u);
+    BOOST_CHECK_EQUAL((universe.getComponentCount<Tag<100>>()), 100u);
+    BOOST_CHECK_EQUAL((universe.getComponentCount<Tag<64>>()), 100u);
+    for (std::size_t k = 0; k < kept.size(); ++k)
+    {
+        const int i = static_cast<int>(2 * k + 1);
+        BOOST_CHECK(!doomed[k].valid());
+        if (i % 3 != 0)
+            BOOST_CHECK_EQUAL(kept[k].get<Tag<64>>().value, i);
+        else
+            BOOST_CHECK_EQUAL(kept[k].get<Tag<100>>().value, 100);
+    }
+
+    //single destroys walk the same bits
+    for (auto& e : kept)
+        e.destroy();
+    BOOST_CHECK_EQUAL(universe.getEntityCount(), 0u);
+    BOOST_CHECK_EQUAL((universe.getComponentCount<Tag<0>>()), 0u);
+    BOOST_CHECK_EQUAL((universe.getComponentCount<Tag<64>>()), 0u);
+}
+
 BOOST_AUTO_TEST_CASE( single_entity )
 {
     struct Position
@@ -269,6 +747,828 @@ BOOST_AUTO_TEST_CASE( test_multi_component )
     BOOST_CHECK_EQUAL(universe.getComponentCount< dom::MultiComponent<Position> >(), 0u);
 }
 
+BOOST_AUTO_TEST_CASE( universe_compaction )
+{
+    struct Position
+    {
+        Position() : x(0), y(0) {}
+        Position(float cx, float cy) : x(cx), y(cy) {}
+
+        float x;
+        float y;
+    };
+
+    dom::Universe<> universe;
+    const std::size_t num = 3*dom::Universe<>::COMPONENT_BLOCK_SIZE;
+    std::vector<dom::EntityHandle<>> entities;
+    for (std::size_t i = 0; i < num; ++i)
+        entities.push_back(universe.create( universe.instantiate<Position>(float(i), 0.0f) ));
+    BOOST_CHECK_EQUAL(universe.getComponentBlockCount<Position>(), 3u);
+
+    //keep every fourth entity of the first third
+    std::vector<dom::EntityHandle<>> survivors;
+    for (std::size_t i = 0; i < num; ++i)
+    {
+        if (i % 4 == 0 && i < num/3)
+            survivors.push_back(entities[i]);
+        else
+            entities[i].destroy();
+    }
+
+    BOOST_CHECK_EQUAL(universe.compact<Position>(10), 10u); //incremental step
+    while (universe.compact<Position>(1000) == 1000) {}
+    BOOST_CHECK_EQUAL(universe.getComponentBlockCount<Position>(), 1u);
+    BOOST_CHECK_EQUAL(universe.getComponentCount<Position>(), survivors.size());
+    BOOST_CHECK_EQUAL(universe.compactAll(), 0u);
+    for (std::size_t i = 0; i < survivors.size(); ++i)
+        BOOST_CHECK_EQUAL(survivors[i].get<Position>().x, float(4*i));
+
+    //two entity blocks are empty now, the component blocks were released by the compaction
+    BOOST_CHECK_EQUAL(universe.trim(), 2u);
+    for (std::size_t i = 0; i < survivors.size(); ++i)
+        BOOST_CHECK(survivors[i].valid());
+    BOOST_CHECK(!entities[1].valid());
+
+    //the pool keeps working after compaction
+    auto e = universe.create<Position>();
+    BOOST_CHECK_EQUAL(e.get<Position>().x, 0.0f);
+    BOOST_CHECK_EQUAL(universe.getComponentCount<Position>(), survivors.size() + 1);
+}
+
+BOOST_AUTO_TEST_CASE( universe_batch_destroy )
+{
+    struct Position
+    {
+        Position() : x(0), y(0) {}
+
+        float x;
+        float y;
+    };
+    struct Health
+    {
+        Health() : hp(100) {}
+
+        int hp;
+    };
+
+    dom::Universe<> universe;
+    std::list<dom::EntityHandle<>> wave;
+    universe.create<Position, Health>(1000, [&wave] (dom::EntityHandle<> e) { wave.push_back(e); });
+    universe.create<Position>(500, [&wave] (dom::EntityHandle<> e) { wave.push_back(e); });
+    auto survivor = universe.create<Health>();
+    auto gone = universe.create<Position>();
+    gone.destroy();
+
+    //duplicates and stale handles are skipped
+    wave.push_back(wave.front());
+    wave.push_back(gone);
+    universe.destroy(wave.begin(), wave.end());
+
+    BOOST_CHECK_EQUAL(universe.getEntityCount(), 1u);
+    BOOST_CHECK_EQUAL(universe.getComponentCount<Position>(), 0u);
+    BOOST_CHECK_EQUAL(universe.getComponentCount<Health>(), 1u);
+    BOOST_CHECK(!wave.front().valid());
+    BOOST_CHECK(survivor.valid());
+    BOOST_CHECK_EQUAL(survivor.get<Health>().hp, 100);
+
+    //the pools keep working
+    auto e = universe.create<Position, Health>();
+    BOOST_CHECK_EQUAL(e.get<Health>().hp, 100);
+    std::vector<dom::EntityHandle<>> rest = { e, survivor };
+    universe.destroy(rest.begin(), rest.end());
+    BOOST_CHECK_EQUAL(universe.getEntityCount(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE( universe_clear )
+{
+    struct Position
+    {
+        Position() : x(0), y(0) {}
+
+        float x;
+        float y;
+    };
+    struct Tracked
+    {
+        Tracked(int* c) : counter(c) { ++*counter; }
+        Tracked(const Tracked& other) : counter(other.counter) { ++*counter; }
+        ~Tracked() { --*counter; }
+
+        int* counter;
+    };
+
+    //a trivial pool is reset without visiting its elements
+    dom::ChunkedArray<int, 64> arr;
+    arr.addN(100, 1);
+    arr.clear();
+    BOOST_CHECK_EQUAL(arr.size(), 0u);
+    BOOST_CHECK_EQUAL(arr.blockCount(), 2u);
+    BOOST_CHECK_EQUAL(arr.add(2).index, 0u);
+
+    int alive = 0;
+    dom::Universe<> universe;
+    std::vector<dom::EntityHandle<>> entities;
+    universe.create<Position>(1000, [&entities] (dom::EntityHandle<> e) { entities.push_back(e); });
+    for (int i = 0; i < 10; ++i)
+        entities[i].add<Tracked>(universe.instantiate<Tracked>(&alive));
+    auto multi = universe.create();
+    multi.add< dom::MultiComponent<Position> >( universe.instantiate< dom::MultiComponent<Position> >(5, universe) );
+    BOOST_CHECK_EQUAL(alive, 10);
+    BOOST_CHECK_EQUAL(universe.getComponentCount<Position>(), 1005u);
+
+    universe.clear();
+    BOOST_CHECK_EQUAL(alive, 0);
+    BOOST_CHECK_EQUAL(universe.getEntityCount(), 0u);
+    BOOST_CHECK_EQUAL(universe.getComponentCount<Position>(), 0u);
+    BOOST_CHECK_EQUAL(universe.getComponentCount<Tracked>(), 0u);
+    BOOST_CHECK_EQUAL(universe.getComponentCount< dom::MultiComponent<Position> >(), 0u);
+    BOOST_CHECK(!entities[0].valid());
+    BOOST_CHECK(!multi.valid());
+    BOOST_CHECK_EQUAL(universe.getComponentBlockCount<Position>(), 1u); //the memory stays for the next level
+
+    //the next level starts from scratch
+    auto e = universe.create<Position>();
+    e.add<Tracked>(universe.instantiate<Tracked>(&alive));
+    BOOST_CHECK(e.has<Position>() && e.has<Tracked>());
+    BOOST_CHECK_EQUAL(alive, 1);
+    e.destroy();
+    BOOST_CHECK_EQUAL(alive, 0);
+}
+
+BOOST_AUTO_TEST_CASE( universe_get_many )
+{
+    struct Position
+    {
+        Position() : x(0), y(0) {}
+
+        float x;
+        float y;
+    };
+    struct Health
+    {
+        Health() : hp(0) {}
+
+        int hp;
+    };
+
+    dom::Universe<> universe;
+    std::vector<dom::EntityHandle<>> entities;
+    universe.create<Health, Position>(100, [&entities] (dom::EntityHandle<> e) { entities.push_back(e); });
+    for (int i = 0; i < 100; ++i)
+        entities[i].modify<Position>().x = float(i);
+
+    //random order, duplicates and fewer entities than the prefetch distance
+    std::vector<dom::EntityHandle<>> targets;
+    for (int i = 0; i < 100; ++i)
+        targets.push_back(entities[(i*37) % 100]);
+    targets.push_back(entities[3]);
+    std::vector<Position*> ptrs(targets.size());
+    universe.getMany<Position>(targets.data(), targets.size(), ptrs.data());
+    for (std::size_t i = 0; i < targets.size(); ++i)
+        BOOST_REQUIRE_EQUAL(ptrs[i], &targets[i].modify<Position>());
+    ptrs[0]->y = 5.0f;
+    BOOST_CHECK_EQUAL(targets[0].get<Position>().y, 5.0f);
+
+    std::vector<Position> copies(3);
+    universe.gatherMany<Position>(targets.data(), 3, copies.data());
+    BOOST_CHECK_EQUAL(copies[1].x, targets[1].get<Position>().x);
+    BOOST_CHECK_EQUAL(copies[0].y, 5.0f);
+    universe.gatherMany<Position>(targets.data(), 0, copies.data());
+
+    universe.destroy(entities.begin(), entities.end());
+}
+
+struct CountingResource : public dom::NewDeleteResource
+{
+    std::size_t outstanding = 0;
+    std::size_t allocations = 0;
+
+    void* allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        outstanding += bytes;
+        ++allocations;
+        return dom::NewDeleteResource::allocate(bytes, alignment);
+    }
+
+    void deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+    {
+        outstanding -= bytes;
+        dom::NewDeleteResource::deallocate(p, bytes, alignment);
+    }
+};
+
+/** \brief Hands out memory from one buffer and never gives it back, like a level arena. */
+struct ArenaResource : public dom::MemoryResource
+{
+    explicit ArenaResource(std::size_t bytes) : buffer(bytes), used(0) {}
+
+    void* allocate(std::size_t bytes, std::size_t alignment) override
+    {
+        std::uintptr_t base = reinterpret_cast<std::uintptr_t>(buffer.data());
+        std::uintptr_t p = (base + used + alignment - 1) & ~(std::uintptr_t(alignment) - 1);
+        if (p + bytes > base + buffer.size())
+            throw std::bad_alloc();
+        used = p + bytes - base;
+        return reinterpret_cast<void*>(p);
+    }
+
+    void deallocate(void*, std::size_t, std::size_t) override {}
+
+    std::vector<unsigned char> buffer;
+    std::size_t used;
+};
+
+BOOST_AUTO_TEST_CASE( universe_memory_resource )
+{
+    struct Position
+    {
+        Position() : x(0), y(0) {}
+
+        float x;
+        float y;
+    };
+    struct Gravity
+    {
+        Gravity() : grav(1) {}
+
+        float grav;
+    };
+
+    CountingResource resource;
+    {
+        dom::Universe<> universe(&resource);
+        std::vector<dom::EntityHandle<>> entities;
+        universe.create<Position, Gravity>(100, [&entities] (dom::EntityHandle<> e) { entities.push_back(e); });
+        entities.push_back(universe.create<Gravity>());
+        BOOST_CHECK(resource.outstanding > 0u);
+        BOOST_CHECK_EQUAL(entities.back().get<Gravity>().grav, 1.0f);
+        //a batch is created pool by pool, so its components are neighbours
+        BOOST_CHECK_EQUAL(&entities[99].get<Position>(), &entities[0].get<Position>() + 99);
+        BOOST_CHECK(entities[99].has<Position>() && entities[99].has<Gravity>());
+        for (auto& e : entities)
+            e.destroy();
+    }
+    //pools, entity records, handle vectors and metadata all went through the resource
+    BOOST_CHECK(resource.allocations > 0u);
+    BOOST_CHECK_EQUAL(resource.outstanding, 0u);
+
+    //a whole world in an arena never touches the global heap, compacting and multi components included
+    ArenaResource buffer(64u << 20);
+    std::vector<dom::EntityHandle<>> world;
+    world.reserve(1000);
+    const std::size_t before = globalAllocations;
+    {
+        dom::Universe<> universe(&buffer);
+        universe.create<Position, Gravity>(1000, [&world] (dom::EntityHandle<> e) { world.push_back(e); });
+        for (std::size_t i = 0; i < world.size(); i += 2)
+            world[i].destroy();
+        universe.compact<Position>();
+        universe.compactAll();
+        dom::MultiComponent<Gravity> gravities(3, universe);
+        dom::MultiComponent<Gravity> copy(gravities);
+        copy = gravities;
+        universe.trim();
+    }
+    BOOST_CHECK_EQUAL(globalAllocations, before);
+    BOOST_CHECK(buffer.used > 0u);
+
+#ifdef DOM_HAS_PMR
+    //a whole world inside an arena, dropped at once
+    std::pmr::monotonic_buffer_resource arena;
+    dom::PmrResource adapter(&arena);
+    dom::Universe<> level(&adapter);
+    level.create<Position, Gravity>(100, [] (dom::EntityHandle<> e) { BOOST_CHECK_EQUAL(e.get<Gravity>().grav, 1.0f); });
+    BOOST_CHECK_EQUAL(level.getComponentCount<Position>(), 100u);
+#endif
+}
+
+BOOST_AUTO_TEST_CASE( inline_component_handles )
+{
+    struct A { int v = 1; };
+    struct B { int v = 2; };
+    struct C { int v = 3; };
+    struct D { int v = 4; };
+    struct E { int v = 5; };
+    struct F { int v = 6; };
+
+    CountingResource resource;
+    dom::Universe<> universe(&resource);
+    universe.reserve(16);
+    universe.create<A, B, C, D>(); //pools, entity block and metadata are allocated now
+    const std::size_t allocations = resource.allocations;
+
+    //up to four handles live in the entity record itself
+    auto e = universe.create<A, B, C, D>();
+    BOOST_CHECK_EQUAL(resource.allocations, allocations);
+    BOOST_CHECK_EQUAL(e.get<C>().v, 3);
+
+    //more components move the handles to a buffer, inserting and erasing keeps their order
+    e.add<F>();
+    e.add<E>();
+    BOOST_CHECK_EQUAL(e.get<A>().v, 1);
+    BOOST_CHECK_EQUAL(e.get<D>().v, 4);
+    BOOST_CHECK_EQUAL(e.get<E>().v, 5);
+    BOOST_CHECK_EQUAL(e.get<F>().v, 6);
+    e.rem<B>();
+    e.rem<E>();
+    BOOST_CHECK(!e.has<B>());
+    BOOST_CHECK_EQUAL(e.get<C>().v, 3);
+    BOOST_CHECK_EQUAL(e.get<F>().v, 6);
+
+    auto copy = e.copy<A, C, D, F>();
+    BOOST_CHECK_EQUAL(copy.get<F>().v, 6);
+    universe.clear();
+}
+
+BOOST_AUTO_TEST_CASE( signature_transitions )
+{
+    struct A { int v = 1; };
+    struct B { int v = 2; };
+    struct C { int v = 3; };
+
+    CountingResource resource;
+    dom::Universe<> universe(&resource);
+    auto e0 = universe.create<A>(); //keeps {A} alive
+    auto e1 = universe.create<A>();
+    auto e2 = universe.create<A, B>();
+    e1.add<B>();
+    e1.rem<B>();
+
+    //the edges {A} <-> {A, B} are cached, toggling B neither hashes nor allocates
+    const std::size_t allocations = resource.allocations;
+    for (int i = 0; i < 100; ++i)
+    {
+        e1.add<B>();
+        e1.rem<B>();
+    }
+    BOOST_CHECK_EQUAL(resource.allocations, allocations);
+
+    //dropping a signature removes the edges into it
+    e2.rem<B>();
+    e1.add<C>();
+    e1.add<B>();
+    BOOST_CHECK(e1.has<B>() && e1.has<C>());
+    e2.add<B>();
+    e2.rem<A>();
+    e2.rem<B>();
+    BOOST_CHECK(!e2.has<A>() && !e2.has<B>());
+    e2.add<A>();
+    BOOST_CHECK_EQUAL(e2.get<A>().v, 1);
+    e1.rem<C>();
+    e1.rem<B>();
+    e1.rem<A>();
+    e1.add<C>();
+    BOOST_CHECK_EQUAL(e1.get<C>().v, 3);
+    BOOST_CHECK(!e1.has<A>());
+    BOOST_CHECK_EQUAL(e0.get<A>().v, 1);
+    universe.clear();
+
+    auto e3 = universe.create<A>();
+    e3.add<B>();
+    BOOST_CHECK_EQUAL(e3.get<B>().v, 2);
+    universe.clear();
+}
+
+#ifdef DOM_HAS_MMAP
+BOOST_AUTO_TEST_CASE( mapped_block_resource )
+{
+    //64 KiB per block, a multiple of every common page size
+    dom::MappedBlockResource mapped(std::size_t(64) << 20);
+    dom::ChunkedArray<std::uint64_t> carray;
+    carray.setBlockResource(&mapped);
+    const std::size_t BLOCK = 8192;
+    std::vector<dom::ChunkedArrayHandle> handles;
+    for (std::size_t i = 0; i < 3*BLOCK; ++i)
+        handles.push_back(carray.add(i));
+
+    //the blocks follow each other in memory
+    BOOST_CHECK_EQUAL(&carray.get(handles[BLOCK]), &carray.get(handles[0]) + BLOCK);
+    BOOST_CHECK_EQUAL(&carray.get(handles[2*BLOCK]), &carray.get(handles[BLOCK]) + BLOCK);
+    BOOST_CHECK_EQUAL(mapped.used(), 3*BLOCK*sizeof(std::uint64_t));
+    BOOST_CHECK_EQUAL(carray.get(handles[2*BLOCK + 5]), 2*BLOCK + 5);
+    BOOST_CHECK_THROW(carray.setBlockResource(dom::defaultResource()), std::logic_error);
+
+    //a released block in the middle is given back and its range is reused
+    for (std::size_t i = BLOCK; i < 2*BLOCK; ++i)
+        carray.destroy(handles[i]);
+    BOOST_CHECK_EQUAL(carray.trim(), 1u);
+    for (std::size_t i = BLOCK; i < 2*BLOCK; ++i)
+        handles[i] = carray.add(i);
+    BOOST_CHECK_EQUAL(&carray.get(handles[BLOCK]), &carray.get(handles[0]) + BLOCK);
+    BOOST_CHECK_EQUAL(mapped.used(), 3*BLOCK*sizeof(std::uint64_t));
+
+    //releasing the top blocks shrinks the used range
+    for (auto h : handles)
+        carray.destroy(h);
+    carray.trim();
+    BOOST_CHECK_EQUAL(mapped.used(), 0u);
+
+    dom::Universe<> universe;
+    universe.setBlockResource<std::uint64_t>(&mapped);
+    auto e = universe.create<std::uint64_t>();
+    e.modify<std::uint64_t>() = 7;
+    BOOST_CHECK_EQUAL(e.get<std::uint64_t>(), 7u);
+    BOOST_CHECK_THROW(universe.setBlockResource<std::uint64_t>(dom::defaultResource()), std::logic_error);
+    e.destroy();
+}
+
+BOOST_AUTO_TEST_CASE( numa_block_resource )
+{
+    //node 0 exists on every machine, but binding may be unavailable; then first touch places the pages
+    const int node = std::max(dom::NumaBlockResource::currentNode(), 0);
+    dom::NumaBlockResource local(node);
+    void* block = local.allocate(std::size_t(1) << 16, 64);
+    BOOST_CHECK_EQUAL(reinterpret_cast<std::uintptr_t>(block) % 64, 0u);
+    std::memset(block, 1, std::size_t(1) << 16);
+    local.deallocate(block, std::size_t(1) << 16, 64);
+
+    //a partition of the simulation lives entirely in a universe on the node of its workers
+    dom::Universe<> partition(&local);
+    std::vector<dom::EntityHandle<>> entities;
+    partition.create<std::uint64_t>(10000, [&entities] (dom::EntityHandle<> e) { entities.push_back(e); });
+    entities.back().modify<std::uint64_t>() = 3;
+    BOOST_CHECK_EQUAL(entities.back().get<std::uint64_t>(), 3u);
+    partition.destroy(entities.begin(), entities.end());
+}
+#endif
+
+struct AlignedVelocity
+{
+    AlignedVelocity() : x(0), y(0), z(0), w(0) {}
+
+    float x, y, z, w;
+};
+
+namespace dom
+{
+    template<>
+    struct ComponentConfig<AlignedVelocity> : public DefaultComponentConfig<AlignedVelocity>
+    {
+        static constexpr std::size_t ALIGNMENT = 64;
+    };
+}
+
+BOOST_AUTO_TEST_CASE( component_alignment )
+{
+    struct Small
+    {
+        Small() : v(0) {}
+
+        char v;
+    };
+
+    dom::Universe<> universe;
+    std::vector<dom::EntityHandle<>> entities;
+    universe.create<AlignedVelocity, Small>(100, [&entities] (dom::EntityHandle<> e) { entities.push_back(e); });
+
+    //every component sits on its own cache line
+    std::vector<const AlignedVelocity*> velocities;
+    universe.forEach<AlignedVelocity>([&velocities] (AlignedVelocity& v) { velocities.push_back(&v); });
+    BOOST_CHECK_EQUAL(velocities.size(), 100u);
+    for (std::size_t i = 0; i < velocities.size(); ++i)
+    {
+        BOOST_CHECK_EQUAL(reinterpret_cast<std::uintptr_t>(velocities[i]) % 64, 0u);
+        if (i > 0)
+            BOOST_CHECK_EQUAL(reinterpret_cast<const char*>(velocities[i]) - reinterpret_cast<const char*>(velocities[i-1]), 64);
+    }
+
+    //blocks of default pools start on a cache line as well, and tiny components are only padded to a free list link
+    BOOST_CHECK_EQUAL(reinterpret_cast<std::uintptr_t>(&entities[0].get<Small>()) % dom::CACHE_LINE_SIZE, 0u);
+    BOOST_CHECK_EQUAL(std::size_t(&entities[1].get<Small>() - &entities[0].get<Small>()), sizeof(dom::ChunkedArrayHandle));
+
+    for (auto& e : entities)
+        e.destroy();
+}
+
+struct Inventory
+{
+    Inventory() : slots{} {}
+
+    int slots[256];
+};
+
+namespace dom
+{
+    template<>
+    struct ComponentConfig<Inventory> : public DefaultComponentConfig<Inventory>
+    {
+        static constexpr std::size_t BLOCK_SIZE = 16;
+        static constexpr std::size_t REUSE_C = 4;
+    };
+}
+
+BOOST_AUTO_TEST_CASE( component_config )
+{
+    CountingResource resource;
+    dom::Universe<> universe(&resource);
+
+    //creating the pool costs no block yet
+    universe.setReusePolicy<Inventory>(dom::ReusePolicy::FREE_ORDER);
+    BOOST_CHECK_EQUAL(universe.getComponentBlockCount<Inventory>(), 0u);
+    const std::size_t before = resource.outstanding;
+    auto first = universe.create<Inventory>();
+    BOOST_CHECK_EQUAL(universe.getComponentBlockCount<Inventory>(), 1u);
+    BOOST_CHECK(resource.outstanding - before < dom::DEFAULT_BLOCK_SIZE*sizeof(Inventory));
+
+    std::vector<dom::EntityHandle<>> entities;
+    universe.create<Inventory>(39, [&entities] (dom::EntityHandle<> e) { entities.push_back(e); });
+    BOOST_CHECK_EQUAL(universe.getComponentBlockCount<Inventory>(), 3u);
+
+    //with REUSE_C == 4 a freed slot is not reused right away
+    const Inventory* freed = &entities[0].get<Inventory>();
+    entities[0].destroy();
+    auto next = universe.create<Inventory>();
+    BOOST_CHECK(&next.get<Inventory>() != freed);
+
+    next.destroy();
+    first.destroy();
+    for (std::size_t i = 1; i < entities.size(); ++i)
+        entities[i].destroy();
+}
+
+struct Particle
+{
+    Particle() : x(0), y(0), id(0) {}
+    Particle(float cx, float cy, int cid) : x(cx), y(cy), id(cid) {}
+
+    float x;
+    float y;
+    int id;
+};
+
+namespace dom
+{
+    template<>
+    struct ComponentConfig<Particle> : public DefaultComponentConfig<Particle>
+    {
+        static constexpr std::size_t BLOCK_SIZE = 64;
+        using Layout = SoALayout< SoAField<Particle, float, &Particle::x>,
+                                  SoAField<Particle, float, &Particle::y>,
+                                  SoAField<Particle, int, &Particle::id> >;
+    };
+}
+
+BOOST_AUTO_TEST_CASE( soa_component )
+{
+    dom::Universe<> universe;
+    std::vector<dom::EntityHandle<>> entities;
+    universe.create<Particle>(100, [&entities] (dom::EntityHandle<> e) { entities.push_back(e); });
+    for (int i = 0; i < 100; ++i)
+        entities[i].modify<Particle>() = Particle(float(i), 1.0f, i);
+    auto single = universe.create<Particle>(universe.instantiate<Particle>(0.5f, 2.0f, 1000));
+    BOOST_CHECK_EQUAL(single.get<Particle>().field<2>(), 1000);
+
+    //fields are accessed one by one through the proxy, or gathered into a Particle
+    entities[7].modify<Particle>().field<1>() = 3.0f;
+    Particle p = entities[7].get<Particle>();
+    BOOST_CHECK_EQUAL(p.x, 7.0f);
+    BOOST_CHECK_EQUAL(p.y, 3.0f);
+    BOOST_CHECK_EQUAL(p.id, 7);
+
+    //each field of a block is one contiguous, cache line aligned array
+    std::size_t blocks = 0;
+    float sum = 0;
+    universe.forEachBlock<Particle>([&] (const dom::SoAChunkedArray<Particle, dom::ComponentConfig<Particle>::Layout, 64>::BlockView& view)
+    {
+        ++blocks;
+        BOOST_CHECK_EQUAL(reinterpret_cast<std::uintptr_t>(view.field<0>()) % dom::CACHE_LINE_SIZE, 0u);
+        for (std::size_t i = 0; i < view.end(); ++i)
+            sum += view.field<0>()[i];
+    });
+    BOOST_CHECK_EQUAL(blocks, 2u);
+    BOOST_CHECK_EQUAL(sum, 4950.5f);
+
+    //compaction moves all fields along
+    for (int i = 0; i < 60; ++i)
+        entities[i].destroy();
+    BOOST_CHECK_EQUAL(universe.compact<Particle>(), 41u);
+    BOOST_CHECK_EQUAL(universe.getComponentBlockCount<Particle>(), 1u);
+    for (int i = 60; i < 100; ++i)
+    {
+        BOOST_REQUIRE_EQUAL(entities[i].get<Particle>().field<0>(), float(i));
+        BOOST_REQUIRE_EQUAL(entities[i].get<Particle>().field<2>(), i);
+    }
+    BOOST_CHECK_EQUAL(single.get<Particle>().field<0>(), 0.5f);
+
+    std::vector<Particle> copies(2);
+    universe.gatherMany<Particle>(&entities[98], 2, copies.data());
+    BOOST_CHECK_EQUAL(copies[1].id, 99);
+
+    universe.clear();
+    BOOST_CHECK_EQUAL(universe.getComponentCount<Particle>(), 0u);
+}
+
+struct TransformHot
+{
+    TransformHot() : x(0), y(0) {}
+    TransformHot(float cx, float cy) : x(cx), y(cy) {}
+
+    float x;
+    float y;
+};
+
+struct TransformCold
+{
+    TransformCold() {}
+    TransformCold(const std::string& cname) : name(cname) {}
+
+    std::string name;
+};
+
+using Transform = dom::SplitComponent<TransformHot, TransformCold>;
+
+BOOST_AUTO_TEST_CASE( split_component )
+{
+    dom::Universe<> universe;
+    std::vector<dom::EntityHandle<>> entities;
+    universe.create<Transform>(10, [&entities] (dom::EntityHandle<> e) { entities.push_back(e); });
+    for (int i = 0; i < 10; ++i)
+    {
+        entities[i].modify<Transform>().hot().x = float(i);
+        entities[i].modify<Transform>().cold().name = "entity" + std::to_string(i);
+    }
+    auto named = universe.create<Transform>(universe.instantiate<Transform>(TransformHot(1.0f, 2.0f), std::string("player")));
+    BOOST_CHECK_EQUAL(named.get<Transform>().hot().y, 2.0f);
+    BOOST_CHECK_EQUAL(named.get<Transform>().cold().name, "player");
+
+    //the hot parts are scanned without the cold ones
+    float sum = 0;
+    universe.forEachHot<Transform>([&sum] (TransformHot& hot) { sum += hot.x; });
+    BOOST_CHECK_EQUAL(sum, 46.0f);
+
+    //copies take both parts along, compaction keeps them together
+    auto copy = named.copy<Transform>();
+    BOOST_CHECK_EQUAL(copy.get<Transform>().cold().name, "player");
+    for (int i = 0; i < 8; ++i)
+        entities[i].destroy();
+    BOOST_CHECK_EQUAL(universe.compact<Transform>(), 4u);
+    BOOST_CHECK_EQUAL(entities[9].get<Transform>().hot().x, 9.0f);
+    BOOST_CHECK_EQUAL(entities[9].get<Transform>().cold().name, "entity9");
+    BOOST_CHECK_EQUAL(copy.get<Transform>().cold().name, "player");
+    Transform value = named.get<Transform>();
+    BOOST_CHECK_EQUAL(value.hot.x, 1.0f);
+
+    universe.clear();
+    BOOST_CHECK_EQUAL(universe.getComponentCount<Transform>(), 0u);
+}
+
+struct Projectile
+{
+    Projectile() : damage(0) {}
+    Projectile(int cdamage, const std::string& cowner) : damage(cdamage), owner(cowner) {}
+
+    int damage;
+    std::string owner;
+};
+
+namespace dom
+{
+    template<>
+    struct ComponentConfig<Projectile> : public DefaultComponentConfig<Projectile>
+    {
+        using Layout = PackedLayout;
+    };
+}
+
+BOOST_AUTO_TEST_CASE( packed_component )
+{
+    //handles survive the swap-remove of other elements
+    dom::PackedArray<int> arr;
+    auto ranges = arr.addN(40, 7);
+    BOOST_REQUIRE_EQUAL(ranges.size(), 1u);
+    BOOST_CHECK_EQUAL(ranges[0].count, 40u);
+    arr.get(ranges[0].handle(39)) = 39;
+    arr.destroy(ranges[0].handle(3));
+    BOOST_CHECK(!arr.alive(ranges[0].handle(3)));
+    BOOST_CHECK_EQUAL(arr.get(ranges[0].handle(39)), 39);
+    BOOST_CHECK_EQUAL(arr.data()[3], 39);
+    BOOST_CHECK(arr.add(1) == ranges[0].handle(3));
+    BOOST_CHECK_EQUAL(arr.size(), 40u);
+
+    dom::Universe<> universe;
+    std::vector<dom::EntityHandle<>> entities;
+    universe.create<Projectile>(20, [&entities] (dom::EntityHandle<> e) { entities.push_back(e); });
+    for (int i = 0; i < 20; ++i)
+        entities[i].modify<Projectile>().damage = i;
+    auto named = universe.create<Projectile>(universe.instantiate<Projectile>(100, std::string("turret")));
+    for (int i = 0; i < 20; i += 2)
+        entities[i].destroy();
+    BOOST_CHECK_EQUAL(universe.getComponentCount<Projectile>(), 11u);
+    BOOST_CHECK_EQUAL(named.get<Projectile>().owner, "turret");
+    for (int i = 1; i < 20; i += 2)
+        BOOST_CHECK_EQUAL(entities[i].get<Projectile>().damage, i);
+
+    //the pool never has holes, so there is nothing to compact
+    int sum = 0;
+    universe.forEach<Projectile>([&sum] (Projectile& p) { sum += p.damage; });
+    BOOST_CHECK_EQUAL(sum, 100 + 100);
+    BOOST_CHECK_EQUAL(universe.compact<Projectile>(), 0u);
+
+    auto copy = named.copy<Projectile>();
+    named.destroy();
+    BOOST_CHECK_EQUAL(copy.get<Projectile>().owner, "turret");
+    universe.clear();
+    BOOST_CHECK_EQUAL(universe.getComponentCount<Projectile>(), 0u);
+
+    //copying from a full pool reads the source before the dense array moves
+    dom::Universe<> full;
+    std::vector<dom::EntityHandle<>> es;
+    for (int i = 0; i < 16; ++i)
+        es.push_back(full.create<Projectile>(full.instantiate<Projectile>(i, std::string("a long owner name, not inline"))));
+    auto clone = es[0].copy<Projectile>();
+    BOOST_CHECK_EQUAL(clone.get<Projectile>().owner, "a long owner name, not inline");
+    BOOST_CHECK_EQUAL(es[15].get<Projectile>().damage, 15);
+    dom::PackedArray<std::string> strings;
+    auto first = strings.addN(16, std::string("a long string, not inline"));
+    strings.addN(4, strings.get(first[0].handle(0)));
+    BOOST_CHECK_EQUAL(strings.data()[19], "a long string, not inline");
+
+    //a throwing constructor takes no slot, the swap-remove still finds the right owners
+    struct Fragile
+    {
+        explicit Fragile(int cvalue) : value(cvalue) { if (cvalue < 0) throw std::runtime_error("fragile"); }
+
+        int value;
+    };
+    dom::PackedArray<Fragile> fragile;
+    auto a = fragile.add(1);
+    BOOST_CHECK_THROW(fragile.add(-1), std::runtime_error);
+    BOOST_CHECK_THROW(fragile.addN(40, -1), std::runtime_error);
+    auto b = fragile.add(2);
+    auto c = fragile.add(3);
+    BOOST_CHECK_EQUAL(fragile.size(), 3u);
+    fragile.destroy(a);
+    BOOST_CHECK_EQUAL(fragile.get(b).value, 2);
+    BOOST_CHECK_EQUAL(fragile.get(c).value, 3);
+    fragile.destroy(b);
+    BOOST_CHECK_EQUAL(fragile.get(c).value, 3);
+    BOOST_CHECK_EQUAL(fragile.size(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE( archetype_universe )
+{
+    struct Position { float x = 0, y = 0; };
+    struct Velocity { float x = 1, y = 1; };
+    struct Name { std::string value; };
+
+    CountingResource resource;
+    {
+    dom::ArchetypeUniverse<> universe(&resource);
+    std::vector<dom::ArchetypeEntity> entities;
+    for (int i = 0; i < 3000; ++i)
+        entities.push_back(universe.create(Position{float(i), 0.0f}, Velocity()));
+    auto named = universe.create(Position(), Name{"player"});
+    auto empty = universe.create();
+    BOOST_CHECK_EQUAL(universe.getEntityCount(), 3002u);
+    BOOST_CHECK_EQUAL(universe.getArchetypeCount(), 3u);
+    BOOST_CHECK(!universe.has<Velocity>(named));
+    BOOST_CHECK_EQUAL(universe.get<Name>(named).value, "player");
+
+    //only the archetypes with both components are streamed
+    std::size_t visited = 0;
+    universe.forEach<Position, Velocity>([&visited] (Position& p, const Velocity& v) { p.x += v.x; ++visited; });
+    BOOST_CHECK_EQUAL(visited, 3000u);
+    BOOST_CHECK_EQUAL(universe.get<Position>(entities[2999]).x, 3000.0f);
+    std::size_t rows = 0, chunks = 0;
+    universe.forEachChunk<Position>([&rows, &chunks] (std::size_t count, Position*) { rows += count; ++chunks; });
+    BOOST_CHECK_EQUAL(rows, 3001u);
+    BOOST_CHECK(chunks > 2u);
+
+    //destroying fills the hole with the last entity of the archetype
+    universe.destroy(entities[5]);
+    BOOST_CHECK(!universe.valid(entities[5]));
+    BOOST_CHECK_EQUAL(universe.get<Position>(entities[2999]).x, 3000.0f);
+    BOOST_CHECK_EQUAL(universe.get<Position>(entities[6]).x, 7.0f);
+
+    //adding and removing moves the entity between archetypes
+    universe.add<Name>(entities[10], Name{"ten"});
+    BOOST_CHECK_EQUAL(universe.getArchetypeCount(), 4u);
+    BOOST_CHECK_EQUAL(universe.get<Name>(entities[10]).value, "ten");
+    BOOST_CHECK_EQUAL(universe.get<Position>(entities[10]).x, 11.0f);
+    universe.remove<Velocity>(entities[10]);
+    BOOST_CHECK(!universe.has<Velocity>(entities[10]));
+    BOOST_CHECK_EQUAL(universe.get<Name>(entities[10]).value, "ten");
+    BOOST_CHECK_EQUAL(universe.get<Position>(entities[10]).x, 11.0f);
+    BOOST_CHECK_EQUAL(universe.get<Position>(entities[2999]).x, 3000.0f);
+    universe.add<Velocity>(empty);
+    BOOST_CHECK_EQUAL(universe.get<Velocity>(empty).y, 1.0f);
+
+    visited = 0;
+    universe.forEach<Name>([&visited] (Name&) { ++visited; });
+    BOOST_CHECK_EQUAL(visited, 2u);
+
+    //handles of destroyed entities stay invalid when their index is reused
+    auto reused = universe.create<Position>();
+    BOOST_CHECK_EQUAL(reused.index, entities[5].index);
+    BOOST_CHECK(!universe.valid(entities[5]));
+
+    universe.clear();
+    BOOST_CHECK_EQUAL(universe.getEntityCount(), 0u);
+    BOOST_CHECK(!universe.valid(named));
+    }
+    BOOST_CHECK_EQUAL(resource.outstanding, 0u);
+}
+
 struct TestMe
 {
     static int dcounter;
@@ -417,4 +1717,22 @@ BOOST_AUTO_TEST_CASE( speed_test )
         });
     end = std::chrono::steady_clock::now();
     std::cout << "Iterated over all components in " << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << " milliseconds" << std::endl << std::endl;
+
+    std::cout << "checking for dom with archetypes" << std::endl;
+
+    dom::ArchetypeUniverse<> archetypes;
+    begin = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < num; ++i)
+        archetypes.create<Position, Velocity>();
+    end = std::chrono::steady_clock::now();
+    std::cout << num << " entities with components created in " << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << " milliseconds" << std::endl << std::endl;
+
+    begin = std::chrono::steady_clock::now();
+    archetypes.forEach<Position, Velocity>([](Position &position, Velocity &direction)
+        {
+          position.x += direction.x;
+          position.y += direction.y;
+        });
+    end = std::chrono::steady_clock::now();
+    std::cout << "Iterated over all components in " << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << " milliseconds" << std::endl << std::endl;
 }